@@ -23,35 +23,249 @@
 #include <stdlib.h>
 #include <math.h>
 #include <vector>
+#include <array>
+#include <string>
 #include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 class Constants{
 public:
   static double kLengthOfSquareDomain_;
   static int kNumOfHeaters_;
   static double kStefanBoltzmann_;
-  static int kNumOfNodesInElement_;
+  static constexpr int kNumOfNodesInElement_=4;
   static int kNumOfDofsPerNode_;
   static int kNumOfMaterials_;
   static double kNormTolerance_;
   static double kYFunctionTolerance_;
   static int kMaxNewtonIteration_;
+  static bool kUseNewtonLineSearch_;
+  static int kMaxLineSearchBacktracks_;
+  static double kLineSearchSufficientDecrease_;
+  static int kTemperaturePredictorOrder_;
+  static bool kUseNestedIteration_;
+  static int kNestedIterationCoarseningFactor_;
   static int kMeshSeedsAlongSiliconThickness_;
   static int kMeshSeedsAlongSTitaniumThickness_;
   static double kMinYCoordinate_;
+  static bool kUseTensorIntegralAssembly_;
+  static int kNumOfAssemblyThreads_;
+  static bool kUseFusedAssembly_;
+  static bool kUseBatchedSimdKernels_;
+  static double kPropertyTableMinTemperature_;
+  static double kPropertyTableMaxTemperature_;
+  static int kNumOfPropertyTableIntervals_;
+  static bool kUseConsistentTangent_;
+  static int kEquationOrdering_;
+  static bool kUseModifiedNewton_;
+  static double kModifiedNewtonContractionThreshold_;
+  static bool kUseMixedPrecisionFactorization_;
+  static int kMaxRefinementSteps_;
+  static double kRefinementRelativeTolerance_;
+  static bool kUseSymmetricEquilibration_;
+  static bool kUsePivotShiftRecovery_;
+  static int kMaxPivotShiftAttempts_;
+  static double kInitialPivotShift_;
+  static double kPivotShiftGrowth_;
+  static int kLinearSolverBackend_;
+  static int kPcgPreconditioner_;
+  static double kPcgRelativeTolerance_;
+  static int kMaxPcgIterations_;
+  static int kGmresRestart_;
+  static int kMaxGmresIterations_;
+  static double kJfnkRelativeTolerance_;
+  static int kJfnkPreconditionerRefreshIterations_;
+  static int kNumOfFactorizationThreads_;
 };
 double Constants::kLengthOfSquareDomain_ = 1.0;
 int Constants::kNumOfHeaters_ = 10;
 double Constants::kStefanBoltzmann_=5.6703e-11; // units mW/(mm^2 * K^4)   5.6703e-8 W*m^-2*K^-4
-int Constants::kNumOfNodesInElement_=4;
+constexpr int Constants::kNumOfNodesInElement_;
 int Constants::kNumOfDofsPerNode_=1;
 int Constants::kNumOfMaterials_=4;
 double Constants::kNormTolerance_=1.0e-5;
 double Constants::kYFunctionTolerance_=1.0e-5;
 int Constants::kMaxNewtonIteration_=10;
+bool Constants::kUseNewtonLineSearch_=false; // halve a newton step whose residual norm does not decrease enough, before cutting the time increment
+int Constants::kMaxLineSearchBacktracks_=4;
+double Constants::kLineSearchSufficientDecrease_=1.0e-4; // accept step length a when |F(T+a*dT)| <= (1-c*a)*|F(T)|
+bool Constants::kUseNestedIteration_=false; // each time step is solved on a coarser mesh first to correct the fine newton starting field
+int Constants::kNestedIterationCoarseningFactor_=2; // divides the seeds on the ends, gaps and heaters of the coarse mesh
+int Constants::kTemperaturePredictorOrder_=1; // newton starts from the last converged field (0) or its linear (1) or quadratic (2) extrapolation in time
 int Constants::kMeshSeedsAlongSiliconThickness_=5;
 int Constants::kMeshSeedsAlongSTitaniumThickness_=1;
 double Constants::kMinYCoordinate_=0.0;
+bool Constants::kUseTensorIntegralAssembly_=true; // conduction and capacity matrices from precomputed element moment tensors
+int Constants::kNumOfAssemblyThreads_=0; // 0 uses every hardware thread
+bool Constants::kUseFusedAssembly_=true; // one element pass straight into the jacobian and the residual
+bool Constants::kUseBatchedSimdKernels_=true; // fused path evaluates K and M for same-material element batches in simd lanes
+double Constants::kPropertyTableMinTemperature_=200.0; // K, range of the material property lookup tables
+double Constants::kPropertyTableMaxTemperature_=2000.0;
+int Constants::kNumOfPropertyTableIntervals_=180;
+bool Constants::kUseConsistentTangent_=true; // newton jacobian with dk/dT and dc/dT terms, solved by a non-symmetric skyline LU
+int Constants::kEquationOrdering_=1; // 0 node order (row by row), 1 column by column through the thickness, 2 reverse cuthill-mckee
+bool Constants::kUseModifiedNewton_=false; // keep the jacobian factor across iterations and time steps while the residual contracts
+double Constants::kModifiedNewtonContractionThreshold_=0.5; // refactor when a solve shrinks the residual norm by less than this ratio
+bool Constants::kUseMixedPrecisionFactorization_=false; // skyline factor in single precision, refined against the double jacobian
+int Constants::kMaxRefinementSteps_=3;
+double Constants::kRefinementRelativeTolerance_=1.0e-8; // on the linear residual relative to the right hand side
+bool Constants::kUseSymmetricEquilibration_=true; // skyline direct factor of D*J*D with D=|diag J|^-1/2
+bool Constants::kUsePivotShiftRecovery_=true; // a failed pivot refactors with a raised diagonal instead of cutting the time increment
+int Constants::kMaxPivotShiftAttempts_=4;
+double Constants::kInitialPivotShift_=1.0e-8; // relative to each diagonal entry
+double Constants::kPivotShiftGrowth_=100.0;
+int Constants::kLinearSolverBackend_=0; // 0 skyline direct factorization, 1 preconditioned conjugate gradient (symmetric tangent only),
+                                        // 2 jacobian-free newton-krylov (gmres on finite difference jacobian products),
+                                        // 3 blocked band cholesky on the thread pool (symmetric tangent only),
+                                        // 4 sparse cholesky in nested dissection order (symmetric tangent only)
+int Constants::kPcgPreconditioner_=2; // 0 jacobi, 1 incomplete cholesky on the element sparsity pattern, 2 geometric multigrid
+double Constants::kPcgRelativeTolerance_=1.0e-10; // on the residual norm relative to the right hand side
+int Constants::kMaxPcgIterations_=5000;
+int Constants::kGmresRestart_=40;
+int Constants::kMaxGmresIterations_=400;
+double Constants::kJfnkRelativeTolerance_=1.0e-6;
+int Constants::kNumOfFactorizationThreads_=0; // blocked band cholesky, 0 uses every hardware thread
+int Constants::kJfnkPreconditionerRefreshIterations_=20; // rebuild the lagged multigrid operator after a slower gmres solve
+
+
+// element vectors and matrices sized at compile time; they live on the stack or inline in their owner
+template<int kNumOfNodes> using ElementVector=std::array<double, kNumOfNodes>;
+template<int kNumOfNodes> using ElementMatrix=std::array<std::array<double, kNumOfNodes>, kNumOfNodes>;
+typedef ElementVector<Constants::kNumOfNodesInElement_> QuadElementVector;
+typedef ElementMatrix<Constants::kNumOfNodesInElement_> QuadElementMatrix;
+
+// gauss-legendre points and weights on [-1,1]
+template<int kNumOfPoints> struct GaussLegendreRule;
+template<> struct GaussLegendreRule<2>{
+  static constexpr int kNumOfTensorProductPoints_=4; //points of the 2x2 rule on a quad
+  static constexpr std::array<double, 2> kCoordinates_={{-0.57735026, 0.57735026}};
+  static constexpr std::array<double, 2> kWeights_={{1.0, 1.0}};
+};
+template<> struct GaussLegendreRule<3>{
+  static constexpr int kNumOfTensorProductPoints_=9; //points of the 3x3 rule on a quad
+  static constexpr std::array<double, 3> kCoordinates_={{-0.7745966692, 0, 0.7745966692}};
+  static constexpr std::array<double, 3> kWeights_={{0.5555555555, 0.8888888888, 0.5555555555}};
+};
+template<> struct GaussLegendreRule<4>{
+  static constexpr int kNumOfTensorProductPoints_=16; //points of the 4x4 rule on a quad
+  static constexpr std::array<double, 4> kCoordinates_={{-0.861136312, -0.339981044, 0.339981044, 0.861136312}};
+  static constexpr std::array<double, 4> kWeights_={{0.347854845, 0.652145155, 0.652145155, 0.347854845}};
+};
+constexpr std::array<double, 2> GaussLegendreRule<2>::kCoordinates_;
+constexpr std::array<double, 2> GaussLegendreRule<2>::kWeights_;
+constexpr std::array<double, 3> GaussLegendreRule<3>::kCoordinates_;
+constexpr std::array<double, 3> GaussLegendreRule<3>::kWeights_;
+constexpr std::array<double, 4> GaussLegendreRule<4>::kCoordinates_;
+constexpr std::array<double, 4> GaussLegendreRule<4>::kWeights_;
+
+
+// One temperature dependent property on a uniform temperature grid. Every node stores the value and the derivative (scaled by
+// the spacing), and a lookup interpolates the cell with a cubic hermite polynomial, so value and derivative come from the same
+// two nodes. Cubic hermite interpolation reproduces polynomials up to degree 3 exactly, so the built-in quadratic fits lose
+// nothing; tabulated curves are resampled onto the grid first. Temperatures outside the grid extrapolate the end cell.
+class MaterialPropertyTable{
+public:
+  void InitializeFromPolynomial(const double*, int);
+  bool InitializeFromSamples(std::vector<double>&, std::vector<double>&);
+  bool is_quadratic() const
+    {return is_quadratic_;}
+  const double* get_quadratic_coefficients() const  //{constant, linear, quadratic}, only meaningful if is_quadratic()
+    {return quadratic_coefficients_;}
+  inline void Evaluate(double, double&, double&) const;
+  inline double Evaluate(double) const;
+
+private:
+  void InitializeGrid();
+  double minimum_temperature_;
+  double spacing_;
+  double inverse_of_spacing_;
+  int num_of_intervals_;
+  std::vector<double> values_and_derivatives_;  //node k: [2k] value, [2k+1] derivative*spacing
+  bool is_quadratic_;
+  double quadratic_coefficients_[3];
+};
+void MaterialPropertyTable::InitializeGrid(){
+  minimum_temperature_=Constants::kPropertyTableMinTemperature_;
+  num_of_intervals_=Constants::kNumOfPropertyTableIntervals_;
+  spacing_=(Constants::kPropertyTableMaxTemperature_-Constants::kPropertyTableMinTemperature_)/num_of_intervals_;
+  inverse_of_spacing_=1.0/spacing_;
+  values_and_derivatives_.assign(2*(num_of_intervals_+1), 0.0);
+}
+
+void MaterialPropertyTable::InitializeFromPolynomial(const double* coefficients, const int num_of_coefficients){
+  InitializeGrid();
+  is_quadratic_=(num_of_coefficients<=3);
+  for(int m=0;m<3;m++)
+    quadratic_coefficients_[m]=(m<num_of_coefficients)?coefficients[m]:0.0;
+  for(int k=0;k<=num_of_intervals_;k++){
+    double temperature=minimum_temperature_+k*spacing_;
+    double value=0.0, derivative=0.0;
+    for(int m=num_of_coefficients-1;m>=0;m--){
+      derivative=derivative*temperature+value;
+      value=value*temperature+coefficients[m];
+    }
+    values_and_derivatives_[2*k]=value;
+    values_and_derivatives_[2*k+1]=derivative*spacing_;
+  }
+}
+
+// samples are (temperature, value) pairs sorted by temperature; the grid takes the piecewise linear curve through them and
+// central differences of the resampled values as nodal derivatives. returns false, leaving the table untouched, if there are
+// no samples or the temperatures do not strictly increase
+bool MaterialPropertyTable::InitializeFromSamples(std::vector<double>& temperatures, std::vector<double>& values){
+  int num_of_samples=temperatures.size();
+  if(num_of_samples<1 || (int)values.size()!=num_of_samples) return false;
+  for(int i=1;i<num_of_samples;i++)
+    if(!(temperatures[i]>temperatures[i-1])) return false;
+  InitializeGrid();
+  is_quadratic_=false;
+  for(int m=0;m<3;m++) quadratic_coefficients_[m]=0.0;
+  int sample=0;
+  for(int k=0;k<=num_of_intervals_;k++){
+    double temperature=minimum_temperature_+k*spacing_;
+    while(sample<num_of_samples-2 && temperatures[sample+1]<temperature) sample++;
+    double value=values[0];
+    if(num_of_samples>1){
+      double slope=(values[sample+1]-values[sample])/(temperatures[sample+1]-temperatures[sample]);
+      value=values[sample]+slope*(temperature-temperatures[sample]);
+    }
+    values_and_derivatives_[2*k]=value;
+  }
+  for(int k=0;k<=num_of_intervals_;k++){
+    int left=(k==0)?0:k-1;
+    int right=(k==num_of_intervals_)?k:k+1;
+    values_and_derivatives_[2*k+1]=(values_and_derivatives_[2*right]-values_and_derivatives_[2*left])/(right-left);
+  }
+  return true;
+}
+
+inline void MaterialPropertyTable::Evaluate(const double temperature, double& value, double& derivative) const{
+  double position=(temperature-minimum_temperature_)*inverse_of_spacing_;
+  int k=(int)position;
+  if(position<0.0) k=0;
+  if(k>num_of_intervals_-1) k=num_of_intervals_-1;
+  double t=position-k;
+  const double* node=&values_and_derivatives_[2*k];
+  double t_square=t*t;
+  double t_cube=t_square*t;
+  value=(2.0*t_cube-3.0*t_square+1.0)*node[0]+(t_cube-2.0*t_square+t)*node[1]+(3.0*t_square-2.0*t_cube)*node[2]+(t_cube-t_square)*node[3];
+  derivative=((6.0*t_square-6.0*t)*(node[0]-node[2])+(3.0*t_square-4.0*t+1.0)*node[1]+(3.0*t_square-2.0*t)*node[3])*inverse_of_spacing_;
+}
+
+inline double MaterialPropertyTable::Evaluate(const double temperature) const{
+  double value, derivative;
+  Evaluate(temperature, value, derivative);
+  return value;
+}
 
 
 class ModelGeometry{
@@ -201,11 +415,11 @@ public:
   }
   int get_dimensions_of_y() const 
     {return dimensions_of_y_;}
-  int set_num_of_nodes()
+  void set_num_of_nodes()
     {num_of_nodes_=dimensions_of_x_*dimensions_of_y_;}
   int get_num_of_nodes() const 
     {return num_of_nodes_;}
-  int set_num_of_elements()
+  void set_num_of_elements()
     {num_of_elements_=(dimensions_of_x_-1)*(dimensions_of_y_-1);}
   int get_num_of_elements() const 
     {return num_of_elements_;}
@@ -629,6 +843,7 @@ public:
   void PrintDofAndEquationNumbers(Initialization *const);
 
 private:
+  void OrderFreeNodes(Initialization *const, std::vector<bool>&, std::vector<int>&);
   std::vector<int> nodes_in_elements_;
   std::vector<int> essential_bc_nodes_;
   int num_of_essential_bc_nodes_;
@@ -678,27 +893,18 @@ void DegreeOfFreedomAndEquationNumbers::GenerateNodeAndEquationNumbersInElements
     }
   }
 
+  std::vector<bool> fixed_nodes(num_of_nodes,false);
+  for(int i=0; i<num_of_essential_bc_nodes_; i++) fixed_nodes[essential_bc_nodes_[i]]=true;
+  std::vector<int> free_nodes_in_order;
+  OrderFreeNodes(initialization, fixed_nodes, free_nodes_in_order);
+
   equation_numbers_of_nodes_.clear();
-  equation_numbers_of_nodes_.resize(num_of_nodes,0);
+  equation_numbers_of_nodes_.resize(num_of_nodes,-1);
   int count_equation_number=0;
-  for(int i=0; i<num_of_nodes; i++){
-    int count_node=0;
-    bool check_fixed_dof = false;
-    while(count_node<num_of_essential_bc_nodes_){ 
-      if(i==essential_bc_nodes_[count_node]){
-        check_fixed_dof = true;
-        break; //find the DOF K that has not been fixed
-      }
-      count_node++;
-    }
-    if(check_fixed_dof == false){
-      equation_numbers_of_nodes_[i]=count_equation_number;
-      count_equation_number++;
-    }
-    else if(check_fixed_dof == true){
-      equation_numbers_of_nodes_[i]=-1;
-    }
-  }    
+  for(int i=0; i<(int)free_nodes_in_order.size(); i++){
+    equation_numbers_of_nodes_[free_nodes_in_order[i]]=count_equation_number;
+    count_equation_number++;
+  }
       
   equation_numbers_in_elements_.clear();
   equation_numbers_in_elements_.resize(Constants::kNumOfNodesInElement_*num_of_elements,0);
@@ -709,7 +915,100 @@ void DegreeOfFreedomAndEquationNumbers::GenerateNodeAndEquationNumbersInElements
     }
   }
 
-  num_of_equations_=equation_numbers_of_nodes_.back()+1;
+  num_of_equations_=count_equation_number;
+}
+
+// order in which the free nodes receive equation numbers. the skyline profile follows the ordering, and the die is far 
+// thinner than it is wide, so numbering across the thickness keeps each row's envelope at about dimensions_of_y instead 
+// of dimensions_of_x.
+void DegreeOfFreedomAndEquationNumbers::OrderFreeNodes(Initialization *const initialization, std::vector<bool>& fixed_nodes, 
+std::vector<int>& free_nodes_in_order){
+  int num_of_nodes=(*((*initialization).get_mesh_parameters())).get_num_of_nodes();
+  int num_of_elements=(*((*initialization).get_mesh_parameters())).get_num_of_elements();
+  int dimensions_of_x=(*((*initialization).get_mesh_parameters())).get_dimensions_of_x();
+  int dimensions_of_y=(*((*initialization).get_mesh_parameters())).get_dimensions_of_y();
+  free_nodes_in_order.clear();
+  free_nodes_in_order.reserve(num_of_nodes);
+
+  if(Constants::kEquationOrdering_==0){
+    for(int i=0; i<num_of_nodes; i++)
+      if(!fixed_nodes[i]) free_nodes_in_order.push_back(i);
+    return;
+  }
+  if(Constants::kEquationOrdering_==1){
+    for(int i=0; i<dimensions_of_x; i++)
+      for(int j=0; j<dimensions_of_y; j++)
+        if(!fixed_nodes[j*dimensions_of_x+i]) free_nodes_in_order.push_back(j*dimensions_of_x+i);
+    return;
+  }
+
+  //reverse cuthill-mckee on the free node graph, neighbours are the nodes sharing an element
+  std::vector<std::vector<int> > neighbours(num_of_nodes);
+  for(int e=0; e<num_of_elements; e++){
+    for(int a=0; a<Constants::kNumOfNodesInElement_; a++){
+      int node_a=nodes_in_elements_[a+e*Constants::kNumOfNodesInElement_];
+      if(fixed_nodes[node_a]) continue;
+      for(int b=0; b<Constants::kNumOfNodesInElement_; b++){
+        int node_b=nodes_in_elements_[b+e*Constants::kNumOfNodesInElement_];
+        if(b!=a && !fixed_nodes[node_b]) neighbours[node_a].push_back(node_b);
+      }
+    }
+  }
+  for(int i=0; i<num_of_nodes; i++){
+    std::sort(neighbours[i].begin(), neighbours[i].end());
+    neighbours[i].erase(std::unique(neighbours[i].begin(), neighbours[i].end()), neighbours[i].end());
+  }
+
+  std::vector<int> level(num_of_nodes,-1);
+  std::vector<int> queue;
+  queue.reserve(num_of_nodes);
+  //breadth first search from root, visiting the unvisited neighbours of each node by increasing degree; returns the last level
+  auto breadth_first_search=[&](int root, bool record){
+    std::fill(level.begin(), level.end(), -1);
+    queue.clear();
+    queue.push_back(root);
+    level[root]=0;
+    std::vector<int> next;
+    for(int head=0; head<(int)queue.size(); head++){
+      int node=queue[head];
+      next.clear();
+      for(int k=0; k<(int)neighbours[node].size(); k++)
+        if(level[neighbours[node][k]]<0) next.push_back(neighbours[node][k]);
+      std::sort(next.begin(), next.end(), [&](int a, int b){
+        return neighbours[a].size()<neighbours[b].size() || (neighbours[a].size()==neighbours[b].size() && a<b);});
+      for(int k=0; k<(int)next.size(); k++){
+        level[next[k]]=level[node]+1;
+        queue.push_back(next[k]);
+      }
+    }
+    if(record) free_nodes_in_order.insert(free_nodes_in_order.end(), queue.rbegin(), queue.rend());
+    return level[queue.back()];
+  };
+
+  std::vector<bool> ordered(num_of_nodes,false);
+  std::vector<int> component;
+  for(int start=0; start<num_of_nodes; start++){
+    if(fixed_nodes[start] || ordered[start]) continue;
+    //pseudo-peripheral root: restart from a smallest degree node of the last level while the eccentricity grows
+    int root=start;
+    int eccentricity=breadth_first_search(root, false);
+    while(true){
+      int candidate=-1;
+      for(int k=0; k<(int)queue.size(); k++){
+        int node=queue[k];
+        if(level[node]==eccentricity && (candidate<0 || neighbours[node].size()<neighbours[candidate].size())) candidate=node;
+      }
+      int candidate_eccentricity=breadth_first_search(candidate, false);
+      if(candidate_eccentricity<=eccentricity) break;
+      root=candidate;
+      eccentricity=candidate_eccentricity;
+    }
+    component.assign(free_nodes_in_order.begin(), free_nodes_in_order.end());
+    free_nodes_in_order.clear();
+    breadth_first_search(root, true);
+    for(int k=0; k<(int)free_nodes_in_order.size(); k++) ordered[free_nodes_in_order[k]]=true;
+    free_nodes_in_order.insert(free_nodes_in_order.begin(), component.begin(), component.end());
+  }
 }
 
 void DegreeOfFreedomAndEquationNumbers::PrintDofAndEquationNumbers(Initialization *const initialization){
@@ -740,28 +1039,103 @@ private:
 void HalfBandWidth::set_accumulative_half_band_width_vector(Initialization *const initialization, DegreeOfFreedomAndEquationNumbers *const dof_and_equation_numbers){
   int num_of_equations = (*dof_and_equation_numbers).get_num_of_equations();
   int num_of_elements = (*((*initialization).get_mesh_parameters())).get_num_of_elements();
-  std::vector<int>& equation_numbers_of_nodes=(*dof_and_equation_numbers).get_equation_numbers_of_nodes();
-  std::vector<int> equation_numbers_in_elements=(*dof_and_equation_numbers).get_equation_numbers_in_elements();
+  std::vector<int>& equation_numbers_in_elements=(*dof_and_equation_numbers).get_equation_numbers_in_elements();
+
+  //one pass over the elements: every equation of an element reaches back to the smallest equation of that element
+  std::vector<int> smallest_equation_numbers(num_of_equations);
+  for(int i=0;i<num_of_equations;i++) smallest_equation_numbers[i]=i;
+  for(int j=0;j<num_of_elements;j++){
+    int smallest_equation_number=num_of_equations;
+    for(int k=0;k<Constants::kNumOfNodesInElement_;k++){
+      int equation_number=equation_numbers_in_elements[k+Constants::kNumOfNodesInElement_*j];
+      if(equation_number>=0 && equation_number<smallest_equation_number) smallest_equation_number=equation_number;
+    }
+    for(int k=0;k<Constants::kNumOfNodesInElement_;k++){
+      int equation_number=equation_numbers_in_elements[k+Constants::kNumOfNodesInElement_*j];
+      if(equation_number>=0 && smallest_equation_number<smallest_equation_numbers[equation_number]) 
+        smallest_equation_numbers[equation_number]=smallest_equation_number;
+    }
+  }
 
-  accumulative_half_band_width_vector_.resize(num_of_equations,0);
-  int smallest_equation_number;
-  for(int i=0;i<num_of_equations;i++){
-    smallest_equation_number=num_of_equations-1;
-    for(int j=0;j<num_of_elements;j++){//searching...
-      for(int k=0;k<Constants::kNumOfNodesInElement_;k++){ //searching...
-        if(equation_numbers_in_elements[k+Constants::kNumOfNodesInElement_*j]==i){
-          for(int l=0;l<Constants::kNumOfNodesInElement_;l++){
-            if(equation_numbers_in_elements[l+Constants::kNumOfNodesInElement_*j]<smallest_equation_number && 
-               equation_numbers_in_elements[l+Constants::kNumOfNodesInElement_*j]>=0) 
-              smallest_equation_number=equation_numbers_in_elements[l+Constants::kNumOfNodesInElement_*j];
-          }
+  accumulative_half_band_width_vector_.assign(num_of_equations,0);
+  for(int i=1;i<num_of_equations;i++){
+    int half_band_width=(i-smallest_equation_numbers[i])+1; // half band width, gap+1
+    accumulative_half_band_width_vector_[i]=accumulative_half_band_width_vector_[i-1]+half_band_width;
+  }
+  size_of_desparsed_stiffness_matrix_ = accumulative_half_band_width_vector_[num_of_equations-1]+1;
+}
+
+
+// Banded storage offset of every (i,j) entry of every element, built once from the half band widths so that assembly is an
+// indexed add. Entries outside the stored lower triangle hold kNotStored_; a free row coupled to a fixed column holds 
+// kFixedColumn_, which drives the boundary condition load correction.
+class ElementScatterMap{
+public:
+  static const int kNotStored_=-1;
+  static const int kFixedColumn_=-2;
+  static const int kNumOfEntriesPerElement_=Constants::kNumOfNodesInElement_*Constants::kNumOfNodesInElement_;
+  void InitializeElementScatterMap(Initialization *const, DegreeOfFreedomAndEquationNumbers *const, HalfBandWidth *const);
+  void InitializeStencilScatterMap(Initialization *const, DegreeOfFreedomAndEquationNumbers *const);
+  const int* get_storage_offsets(const int element_number) const
+    {return &storage_offsets_[element_number*kNumOfEntriesPerElement_];}
+
+private:
+  std::vector<int> storage_offsets_;
+};
+const int ElementScatterMap::kNotStored_;
+const int ElementScatterMap::kFixedColumn_;
+void ElementScatterMap::InitializeElementScatterMap(Initialization *const initialization, 
+DegreeOfFreedomAndEquationNumbers *const dof_and_equation_numbers, HalfBandWidth *const half_band_width){
+  int num_of_elements = (*((*initialization).get_mesh_parameters())).get_num_of_elements();
+  std::vector<int>& equation_numbers_in_elements=(*dof_and_equation_numbers).get_equation_numbers_in_elements();
+  std::vector<int>& accumulative_half_band_width_vector=(*half_band_width).get_accumulative_half_band_width_vector();
+
+  storage_offsets_.assign(num_of_elements*kNumOfEntriesPerElement_, kNotStored_);
+  for(int element_number=0;element_number<num_of_elements;element_number++){
+    for(int i=0;i<Constants::kNumOfNodesInElement_;i++){
+      int row_equation_number=equation_numbers_in_elements[i+element_number*Constants::kNumOfNodesInElement_];
+      if(row_equation_number<0) continue;
+      for(int j=0;j<Constants::kNumOfNodesInElement_;j++){
+        int column_equation_number=equation_numbers_in_elements[j+element_number*Constants::kNumOfNodesInElement_];
+        int& storage_offset=storage_offsets_[element_number*kNumOfEntriesPerElement_+i*Constants::kNumOfNodesInElement_+j];
+        if(column_equation_number<0)
+          storage_offset=kFixedColumn_;
+        else if(column_equation_number<=row_equation_number)
+          storage_offset=accumulative_half_band_width_vector[row_equation_number]-(row_equation_number-column_equation_number);
+      }
+    }
+  }
+}
+
+// offsets into a full 9 point stencil per node instead of the skyline profile, used by the jacobian-free mode whose lagged 
+// tangent only feeds the multigrid preconditioner. node (column,row) owns entries (column*dimensions_of_y+row)*9, its 
+// neighbour at (column+dc,row+dr) sitting at (dc+1)*3+(dr+1); both triangles are stored.
+void ElementScatterMap::InitializeStencilScatterMap(Initialization *const initialization, 
+DegreeOfFreedomAndEquationNumbers *const dof_and_equation_numbers){
+  int num_of_elements = (*((*initialization).get_mesh_parameters())).get_num_of_elements();
+  int dimensions_of_x = (*((*initialization).get_mesh_parameters())).get_dimensions_of_x();
+  int dimensions_of_y = (*((*initialization).get_mesh_parameters())).get_dimensions_of_y();
+  std::vector<int>& nodes_in_elements=(*dof_and_equation_numbers).get_nodes_in_elements();
+  std::vector<int>& equation_numbers_in_elements=(*dof_and_equation_numbers).get_equation_numbers_in_elements();
+
+  storage_offsets_.assign(num_of_elements*kNumOfEntriesPerElement_, kNotStored_);
+  for(int element_number=0;element_number<num_of_elements;element_number++){
+    for(int i=0;i<Constants::kNumOfNodesInElement_;i++){
+      if(equation_numbers_in_elements[i+element_number*Constants::kNumOfNodesInElement_]<0) continue;
+      int row_node=nodes_in_elements[i+element_number*Constants::kNumOfNodesInElement_];
+      for(int j=0;j<Constants::kNumOfNodesInElement_;j++){
+        int column_node=nodes_in_elements[j+element_number*Constants::kNumOfNodesInElement_];
+        int& storage_offset=storage_offsets_[element_number*kNumOfEntriesPerElement_+i*Constants::kNumOfNodesInElement_+j];
+        if(equation_numbers_in_elements[j+element_number*Constants::kNumOfNodesInElement_]<0){
+          storage_offset=kFixedColumn_;
+          continue;
         }
-      }  
+        int column_shift=column_node%dimensions_of_x-row_node%dimensions_of_x;
+        int row_shift=column_node/dimensions_of_x-row_node/dimensions_of_x;
+        storage_offset=((row_node%dimensions_of_x)*dimensions_of_y+row_node/dimensions_of_x)*9+(column_shift+1)*3+(row_shift+1);
+      }
     }
-    int half_band_width=(i-smallest_equation_number)+1; // half band width, gap+1
-    if(i!=0) accumulative_half_band_width_vector_[i]=accumulative_half_band_width_vector_[i-1]+half_band_width;
   }
-  size_of_desparsed_stiffness_matrix_ = accumulative_half_band_width_vector_[num_of_equations-1]+1;
 }
 
 
@@ -770,7 +1144,7 @@ void HalfBandWidth::set_accumulative_half_band_width_vector(Initialization *cons
 class BoundaryCondition{
 public:
   void InitializeBoundaryCondition(Initialization *const);
-  void FixTemperature(int, std::vector<std::vector<double> >&, std::vector<int>&, std::vector<double>&);
+  void FixTemperature(int, const QuadElementMatrix&, const int*, std::vector<int>&, std::vector<double>&);
   void PrintBoundaryConditionNodes(std::vector<int>& essential_bc_nodes){
     int num_of_essential_bc_nodes = essential_bc_nodes.size();
     for(int i=0;i<num_of_essential_bc_nodes;i++)
@@ -785,12 +1159,13 @@ void BoundaryCondition::InitializeBoundaryCondition(Initialization *const initia
   boundary_condition_temperature_=(*((*initialization).get_analysis_constants())).get_boundary_condition_temperature();
 }
 
-void BoundaryCondition::FixTemperature(const int element_number, std::vector<std::vector<double> >&element_stiffness_matrix, std::vector<int>&equation_numbers_in_elements, std::vector<double>&heat_load){
+// storage_offsets is the element's row of ElementScatterMap
+void BoundaryCondition::FixTemperature(const int element_number, const QuadElementMatrix& element_stiffness_matrix, const int* storage_offsets, 
+std::vector<int>&equation_numbers_in_elements, std::vector<double>&heat_load){
   for(int k=0;k<Constants::kNumOfNodesInElement_;k++){
-    int row_equation_number=equation_numbers_in_elements[k+Constants::kNumOfNodesInElement_*element_number]; 
     for(int jj=0;jj<Constants::kNumOfNodesInElement_;jj++){//loop over all force components in this element
-      int column_equation_number=equation_numbers_in_elements[jj+Constants::kNumOfNodesInElement_*element_number]; 
-      if(row_equation_number>=0 && column_equation_number<0){
+      if(storage_offsets[k*Constants::kNumOfNodesInElement_+jj]==ElementScatterMap::kFixedColumn_){
+        int row_equation_number=equation_numbers_in_elements[k+Constants::kNumOfNodesInElement_*element_number]; 
         heat_load[row_equation_number] += -(element_stiffness_matrix[k][jj]*boundary_condition_temperature_);
       }
     }//for
@@ -810,27 +1185,20 @@ public:
   void PrintDeterminantOfJacobianMatrix();
 
 protected:
-  std::vector<std::vector<double> > coordinates_in_this_element_;
-  std::vector<double> shape_function_;
-  std::vector<std::vector<double> > shape_function_derivatives_;
-  std::vector<std::vector<double> > dn_dx_;
+  std::array<QuadElementVector, 2> coordinates_in_this_element_;
+  QuadElementVector shape_function_;
+  std::array<QuadElementVector, 2> shape_function_derivatives_;
+  std::array<QuadElementVector, 2> dn_dx_;
   double determinant_of_jacobian_matrix_;
   double jacobian_matrix_[2][2];
 };
 void MappingShapeFunctionAndDerivatives::InitializeMappingShapeFunctionAndDerivatives(){
-  coordinates_in_this_element_.resize(2);
-  coordinates_in_this_element_[0].resize(Constants::kNumOfNodesInElement_, 0.0);
-  coordinates_in_this_element_[1].resize(Constants::kNumOfNodesInElement_, 0.0);
-  
-  shape_function_.resize(Constants::kNumOfNodesInElement_, 0.0);
-   
-  shape_function_derivatives_.resize(2);
-  shape_function_derivatives_[0].resize(Constants::kNumOfNodesInElement_, 0.0);
-  shape_function_derivatives_[1].resize(Constants::kNumOfNodesInElement_, 0.0);
-
-  dn_dx_.resize(2);
-  dn_dx_[0].resize(Constants::kNumOfNodesInElement_, 0.0);
-  dn_dx_[1].resize(Constants::kNumOfNodesInElement_, 0.0);
+  shape_function_.fill(0.0);
+  for(int v=0;v<2;v++){
+    coordinates_in_this_element_[v].fill(0.0);
+    shape_function_derivatives_[v].fill(0.0);
+    dn_dx_[v].fill(0.0);
+  }
 }
 
 void MappingShapeFunctionAndDerivatives::set_coordinates_in_this_element(const int element_number, std::vector<int>& nodes_in_elements,
@@ -914,6 +1282,396 @@ void MappingShapeFunctionAndDerivatives::PrintDeterminantOfJacobianMatrix(){
 }
 
 
+// The mesh never changes during a run, so shape functions, their global derivatives and det(J)*weight are evaluated once per 
+// element and quadrature point and stored flat: point q of element e starts at (e*num_of_integration_points+q).
+class ElementGeometryCache:public MappingShapeFunctionAndDerivatives{
+public:
+  void InitializeElementGeometryCache(int, const double*, const double*, int, std::vector<int>&, std::vector<double>&, 
+  std::vector<double>&);
+  int get_num_of_integration_points() const
+    {return num_of_integration_points_;}
+  const double* get_shape_function(const int element_number, const int integration_point) const
+    {return &shape_function_cache_[(element_number*num_of_integration_points_+integration_point)*Constants::kNumOfNodesInElement_];}
+  const double* get_dn_dx(const int element_number, const int integration_point) const  //x derivatives followed by y derivatives
+    {return &dn_dx_cache_[(element_number*num_of_integration_points_+integration_point)*2*Constants::kNumOfNodesInElement_];}
+  double get_determinant_times_weight(const int element_number, const int integration_point) const
+    {return determinant_times_weight_cache_[element_number*num_of_integration_points_+integration_point];}
+
+private:
+  int num_of_integration_points_;
+  std::vector<double> shape_function_cache_;
+  std::vector<double> dn_dx_cache_;
+  std::vector<double> determinant_times_weight_cache_;
+};
+void ElementGeometryCache::InitializeElementGeometryCache(const int num_of_integration_points_per_direction, 
+const double* coordinates_of_integration_points, const double* weights_of_integration_points, const int num_of_elements, 
+std::vector<int>& nodes_in_elements, std::vector<double>& x_coordinates, std::vector<double>& y_coordinates){
+  InitializeMappingShapeFunctionAndDerivatives();
+  num_of_integration_points_=num_of_integration_points_per_direction*num_of_integration_points_per_direction;
+  shape_function_cache_.assign(num_of_elements*num_of_integration_points_*Constants::kNumOfNodesInElement_, 0.0);
+  dn_dx_cache_.assign(num_of_elements*num_of_integration_points_*2*Constants::kNumOfNodesInElement_, 0.0);
+  determinant_times_weight_cache_.assign(num_of_elements*num_of_integration_points_, 0.0);
+
+  for(int element_number=0; element_number<num_of_elements; element_number++){
+    set_coordinates_in_this_element(element_number, nodes_in_elements, x_coordinates, y_coordinates);
+    for(int k=0;k<num_of_integration_points_per_direction;k++){
+      for(int l=0;l<num_of_integration_points_per_direction;l++){
+        int point=element_number*num_of_integration_points_+k*num_of_integration_points_per_direction+l;
+        set_shape_function(coordinates_of_integration_points[k], coordinates_of_integration_points[l]);
+        set_shape_function_derivatives(coordinates_of_integration_points[k], coordinates_of_integration_points[l]);
+        set_determinant_of_jacobian_matrix();
+        set_dn_dx();
+        for(int m=0;m<Constants::kNumOfNodesInElement_;m++){
+          shape_function_cache_[point*Constants::kNumOfNodesInElement_+m]=shape_function_[m];
+          dn_dx_cache_[point*2*Constants::kNumOfNodesInElement_+m]=dn_dx_[0][m];
+          dn_dx_cache_[point*2*Constants::kNumOfNodesInElement_+Constants::kNumOfNodesInElement_+m]=dn_dx_[1][m];
+        }
+        determinant_times_weight_cache_[point]=determinant_of_jacobian_matrix_
+                                              *weights_of_integration_points[k]*weights_of_integration_points[l];
+      }
+    }
+  }
+}
+
+
+// Quadrature kernels over the cached geometry. Node and point counts are template parameters, so the loops have fixed trip 
+// counts the compiler unrolls and the element matrices stay on the caller's stack. kNumOfIntegrationPoints must match the cache.
+template<int kNumOfNodes, int kNumOfIntegrationPoints>
+inline void IntegrateConduction(const ElementGeometryCache& element_geometry_cache, const int element_number, 
+const ElementVector<kNumOfNodes>& nodal_temperatures, const MaterialPropertyTable& thermal_conductivity, 
+ElementMatrix<kNumOfNodes>& element_stiffness_matrix){
+  for(int i=0;i<kNumOfNodes;i++)
+    element_stiffness_matrix[i].fill(0.0);
+  for(int q=0;q<kNumOfIntegrationPoints;q++){
+    const double* shape_function=element_geometry_cache.get_shape_function(element_number, q);
+    const double* dn_dx=element_geometry_cache.get_dn_dx(element_number, q);
+    const double* dn_dy=dn_dx+kNumOfNodes;
+    double temperature=0.0;
+    for(int a=0;a<kNumOfNodes;a++)
+      temperature += nodal_temperatures[a]*shape_function[a];
+    double conductivity_times_weight=thermal_conductivity.Evaluate(temperature)
+                                     *element_geometry_cache.get_determinant_times_weight(element_number, q);
+    for(int i=0;i<kNumOfNodes;i++)
+      for(int j=0;j<kNumOfNodes;j++)
+        element_stiffness_matrix[i][j] += conductivity_times_weight*(dn_dx[i]*dn_dx[j]+dn_dy[i]*dn_dy[j]);
+  }
+}
+
+template<int kNumOfNodes, int kNumOfIntegrationPoints>
+inline void IntegrateCapacity(const ElementGeometryCache& element_geometry_cache, const int element_number, 
+const ElementVector<kNumOfNodes>& nodal_temperatures, const MaterialPropertyTable& specific_heat, const double density_over_time_increment, 
+ElementMatrix<kNumOfNodes>& element_mass_matrix){
+  for(int i=0;i<kNumOfNodes;i++)
+    element_mass_matrix[i].fill(0.0);
+  for(int q=0;q<kNumOfIntegrationPoints;q++){
+    const double* shape_function=element_geometry_cache.get_shape_function(element_number, q);
+    double temperature=0.0;
+    for(int a=0;a<kNumOfNodes;a++)
+      temperature += nodal_temperatures[a]*shape_function[a];
+    double capacity_times_weight=specific_heat.Evaluate(temperature)*density_over_time_increment
+                                 *element_geometry_cache.get_determinant_times_weight(element_number, q);
+    for(int i=0;i<kNumOfNodes;i++)
+      for(int j=0;j<kNumOfNodes;j++)
+        element_mass_matrix[i][j] += capacity_times_weight*shape_function[i]*shape_function[j];
+  }
+}
+
+// Derivative of the conduction and capacity residual terms with respect to the temperatures through k(T) and c(T):
+//   element_tangent_ia = integral( dk/dT*(dNi/dx.grad T)*Na + rho/dt*dc/dT*(T-T0)*Ni*Na )
+// it is not symmetric, and added to K+M it gives the consistent newton tangent.
+template<int kNumOfNodes, int kNumOfIntegrationPoints>
+inline void IntegrateConductionAndCapacityTangent(const ElementGeometryCache& element_geometry_cache, const int element_number, 
+const ElementVector<kNumOfNodes>& nodal_temperatures, const ElementVector<kNumOfNodes>& nodal_temperature_increments, 
+const MaterialPropertyTable& thermal_conductivity, const MaterialPropertyTable& specific_heat, const double density_over_time_increment, 
+ElementMatrix<kNumOfNodes>& element_tangent){
+  for(int i=0;i<kNumOfNodes;i++)
+    element_tangent[i].fill(0.0);
+  for(int q=0;q<kNumOfIntegrationPoints;q++){
+    const double* shape_function=element_geometry_cache.get_shape_function(element_number, q);
+    const double* dn_dx=element_geometry_cache.get_dn_dx(element_number, q);
+    const double* dn_dy=dn_dx+kNumOfNodes;
+    double temperature=0.0, temperature_increment=0.0, temperature_dx=0.0, temperature_dy=0.0;
+    for(int a=0;a<kNumOfNodes;a++){
+      temperature += nodal_temperatures[a]*shape_function[a];
+      temperature_increment += nodal_temperature_increments[a]*shape_function[a];
+      temperature_dx += nodal_temperatures[a]*dn_dx[a];
+      temperature_dy += nodal_temperatures[a]*dn_dy[a];
+    }
+    double conductivity, conductivity_derivative, specific_heat_value, specific_heat_derivative;
+    thermal_conductivity.Evaluate(temperature, conductivity, conductivity_derivative);
+    specific_heat.Evaluate(temperature, specific_heat_value, specific_heat_derivative);
+    double determinant_times_weight=element_geometry_cache.get_determinant_times_weight(element_number, q);
+    double conduction_factor=conductivity_derivative*determinant_times_weight;
+    double capacity_factor=density_over_time_increment*specific_heat_derivative*temperature_increment*determinant_times_weight;
+    for(int i=0;i<kNumOfNodes;i++){
+      double row_factor=conduction_factor*(dn_dx[i]*temperature_dx+dn_dy[i]*temperature_dy)+capacity_factor*shape_function[i];
+      for(int a=0;a<kNumOfNodes;a++)
+        element_tangent[i][a] += row_factor*shape_function[a];
+    }
+  }
+}
+
+
+// k(T) and c(T) are quadratic in T and T is bilinear inside an element, so the conduction and capacity matrices are exactly
+//   K_ij = k0*G_ij + k1*G_ija*T_a + k2*G_ijab*T_a*T_b,  G_ij..=integral(N_a..*dNi/dx.dNj/dx)
+//   M_ij = rho/dt*(c0*H_ij + c1*H_ija*T_a + c2*H_ijab*T_a*T_b),  H_ij..=integral(N_a..*Ni*Nj)
+// The moments are integrated once with the same 3x3 rule (exact for these degrees on the rectangular elements) and stored
+// packed over the symmetric pairs i<=j and a<=b, so each newton iteration only contracts them with the nodal temperatures.
+class ElementTensorIntegrals{
+public:
+  void InitializeElementTensorIntegrals(int, ElementGeometryCache*const);
+  void ContractElementMatrices(int, const QuadElementVector&, const double*, const double*, double, QuadElementMatrix&, QuadElementMatrix&);
+
+private:
+  static const int kNumOfSymmetricPairs_=10;
+  static const int kNumOfMomentsPerPair_=15; //1 constant, 4 linear, 10 quadratic
+  static const int kNumOfMomentsPerElement_=kNumOfSymmetricPairs_*kNumOfMomentsPerPair_;
+  int first_node_of_pair_[kNumOfSymmetricPairs_];
+  int second_node_of_pair_[kNumOfSymmetricPairs_];
+  std::vector<double> stiffness_moments_;
+  std::vector<double> mass_moments_;
+};
+void ElementTensorIntegrals::InitializeElementTensorIntegrals(const int num_of_elements, ElementGeometryCache *const element_geometry_cache){
+  int count_pair=0;
+  for(int i=0;i<Constants::kNumOfNodesInElement_;i++){
+    for(int j=i;j<Constants::kNumOfNodesInElement_;j++){
+      first_node_of_pair_[count_pair]=i;
+      second_node_of_pair_[count_pair]=j;
+      count_pair++;
+    }
+  }
+  stiffness_moments_.assign(num_of_elements*kNumOfMomentsPerElement_, 0.0);
+  mass_moments_.assign(num_of_elements*kNumOfMomentsPerElement_, 0.0);
+
+  for(int element_number=0;element_number<num_of_elements;element_number++){
+    double* stiffness_moments=&stiffness_moments_[element_number*kNumOfMomentsPerElement_];
+    double* mass_moments=&mass_moments_[element_number*kNumOfMomentsPerElement_];
+    for(int q=0;q<(*element_geometry_cache).get_num_of_integration_points();q++){
+      const double* shape_function=(*element_geometry_cache).get_shape_function(element_number, q);
+      const double* dn_dx=(*element_geometry_cache).get_dn_dx(element_number, q);
+      const double* dn_dy=dn_dx+Constants::kNumOfNodesInElement_;
+      double determinant_times_weight=(*element_geometry_cache).get_determinant_times_weight(element_number, q);
+
+      for(int p=0;p<kNumOfSymmetricPairs_;p++){
+        int i=first_node_of_pair_[p];
+        int j=second_node_of_pair_[p];
+        double gradient_product=(dn_dx[i]*dn_dx[j]+dn_dy[i]*dn_dy[j])*determinant_times_weight;
+        double shape_product=shape_function[i]*shape_function[j]*determinant_times_weight;
+        double* stiffness_moments_of_pair=stiffness_moments+p*kNumOfMomentsPerPair_;
+        double* mass_moments_of_pair=mass_moments+p*kNumOfMomentsPerPair_;
+        stiffness_moments_of_pair[0] += gradient_product;
+        mass_moments_of_pair[0] += shape_product;
+        for(int a=0;a<Constants::kNumOfNodesInElement_;a++){
+          stiffness_moments_of_pair[1+a] += shape_function[a]*gradient_product;
+          mass_moments_of_pair[1+a] += shape_function[a]*shape_product;
+        }
+        for(int ab=0;ab<kNumOfSymmetricPairs_;ab++){
+          double shape_function_pair=shape_function[first_node_of_pair_[ab]]*shape_function[second_node_of_pair_[ab]];
+          stiffness_moments_of_pair[5+ab] += shape_function_pair*gradient_product;
+          mass_moments_of_pair[5+ab] += shape_function_pair*shape_product;
+        }
+      }
+    }
+  }
+}
+
+void ElementTensorIntegrals::ContractElementMatrices(const int element_number, const QuadElementVector& nodal_temperatures, 
+const double* conductivity_coefficients, const double* specific_heat_coefficients, const double density_over_time_increment,
+QuadElementMatrix& element_stiffness_matrix, QuadElementMatrix& element_mass_matrix){
+  //temperature monomials matching the packed moment layout; off-diagonal products appear twice in T_a*T_b
+  double temperature_pairs[kNumOfSymmetricPairs_];
+  for(int ab=0;ab<kNumOfSymmetricPairs_;ab++){
+    int a=first_node_of_pair_[ab];
+    int b=second_node_of_pair_[ab];
+    temperature_pairs[ab]=(a==b)?nodal_temperatures[a]*nodal_temperatures[a]:2.0*nodal_temperatures[a]*nodal_temperatures[b];
+  }
+
+  const double* stiffness_moments=&stiffness_moments_[element_number*kNumOfMomentsPerElement_];
+  const double* mass_moments=&mass_moments_[element_number*kNumOfMomentsPerElement_];
+  for(int p=0;p<kNumOfSymmetricPairs_;p++){
+    const double* stiffness_moments_of_pair=stiffness_moments+p*kNumOfMomentsPerPair_;
+    const double* mass_moments_of_pair=mass_moments+p*kNumOfMomentsPerPair_;
+    double stiffness_linear=0.0, stiffness_quadratic=0.0, mass_linear=0.0, mass_quadratic=0.0;
+    for(int a=0;a<Constants::kNumOfNodesInElement_;a++){
+      stiffness_linear += stiffness_moments_of_pair[1+a]*nodal_temperatures[a];
+      mass_linear += mass_moments_of_pair[1+a]*nodal_temperatures[a];
+    }
+    for(int ab=0;ab<kNumOfSymmetricPairs_;ab++){
+      stiffness_quadratic += stiffness_moments_of_pair[5+ab]*temperature_pairs[ab];
+      mass_quadratic += mass_moments_of_pair[5+ab]*temperature_pairs[ab];
+    }
+    double stiffness_entry=conductivity_coefficients[0]*stiffness_moments_of_pair[0]+conductivity_coefficients[1]*stiffness_linear
+                          +conductivity_coefficients[2]*stiffness_quadratic;
+    double mass_entry=density_over_time_increment*(specific_heat_coefficients[0]*mass_moments_of_pair[0]
+                     +specific_heat_coefficients[1]*mass_linear+specific_heat_coefficients[2]*mass_quadratic);
+    int i=first_node_of_pair_[p];
+    int j=second_node_of_pair_[p];
+    element_stiffness_matrix[i][j]=stiffness_entry;
+    element_stiffness_matrix[j][i]=stiffness_entry;
+    element_mass_matrix[i][j]=mass_entry;
+    element_mass_matrix[j][i]=mass_entry;
+  }
+}
+
+
+// Lane arithmetic for the batched element kernels: 8 doubles per register with AVX-512, 4 with AVX2, otherwise plain scalars.
+#if defined(__AVX512F__)
+typedef __m512d SimdDouble;
+const int kSimdWidth=8;
+inline SimdDouble SimdLoad(const double* address){return _mm512_loadu_pd(address);}
+inline void SimdStore(double* address, const SimdDouble value){_mm512_storeu_pd(address, value);}
+inline SimdDouble SimdBroadcast(const double value){return _mm512_set1_pd(value);}
+inline SimdDouble SimdAdd(const SimdDouble a, const SimdDouble b){return _mm512_add_pd(a, b);}
+inline SimdDouble SimdMultiply(const SimdDouble a, const SimdDouble b){return _mm512_mul_pd(a, b);}
+inline SimdDouble SimdMultiplyAdd(const SimdDouble a, const SimdDouble b, const SimdDouble c){return _mm512_fmadd_pd(a, b, c);}
+#elif defined(__AVX2__)
+typedef __m256d SimdDouble;
+const int kSimdWidth=4;
+inline SimdDouble SimdLoad(const double* address){return _mm256_loadu_pd(address);}
+inline void SimdStore(double* address, const SimdDouble value){_mm256_storeu_pd(address, value);}
+inline SimdDouble SimdBroadcast(const double value){return _mm256_set1_pd(value);}
+inline SimdDouble SimdAdd(const SimdDouble a, const SimdDouble b){return _mm256_add_pd(a, b);}
+inline SimdDouble SimdMultiply(const SimdDouble a, const SimdDouble b){return _mm256_mul_pd(a, b);}
+#if defined(__FMA__)
+inline SimdDouble SimdMultiplyAdd(const SimdDouble a, const SimdDouble b, const SimdDouble c){return _mm256_fmadd_pd(a, b, c);}
+#else
+inline SimdDouble SimdMultiplyAdd(const SimdDouble a, const SimdDouble b, const SimdDouble c){return _mm256_add_pd(_mm256_mul_pd(a, b), c);}
+#endif
+#else
+typedef double SimdDouble;
+const int kSimdWidth=1;
+inline SimdDouble SimdLoad(const double* address){return *address;}
+inline void SimdStore(double* address, const SimdDouble value){*address=value;}
+inline SimdDouble SimdBroadcast(const double value){return value;}
+inline SimdDouble SimdAdd(const SimdDouble a, const SimdDouble b){return a+b;}
+inline SimdDouble SimdMultiply(const SimdDouble a, const SimdDouble b){return a*b;}
+inline SimdDouble SimdMultiplyAdd(const SimdDouble a, const SimdDouble b, const SimdDouble c){return a*b+c;}
+#endif
+
+
+// Conduction and capacity kernels for batches of up to kBatchWidth_ elements of one material that share no node. The geometry
+// of a batch is stored structure-of-arrays, lane fastest: for every gauss point N[4][lane], dN/dx[4][lane], dN/dy[4][lane] and
+// det(J)*w[lane], so the property polynomials and the quadrature sums run across the lanes. Short batches repeat their last
+// element in the unused lanes.
+class BatchedElementKernels{
+public:
+  static const int kBatchWidth_=8;
+  void InitializeBatchedElementKernels(ElementGeometryCache*const);
+  int AddBatch(std::vector<int>&);
+  int get_num_of_lanes(const int batch_number) const
+    {return num_of_lanes_in_batches_[batch_number];}
+  const int* get_element_numbers(const int batch_number) const
+    {return &element_numbers_in_batches_[batch_number*kBatchWidth_];}
+  void ComputeConductionAndCapacity(int, const double*, const double*, const double*, double, double*, double*);
+
+private:
+  static const int kGeometryPerIntegrationPoint_=(3*4+1)*kBatchWidth_;
+  ElementGeometryCache* element_geometry_cache_;
+  int num_of_integration_points_;
+  std::vector<int> element_numbers_in_batches_;
+  std::vector<int> num_of_lanes_in_batches_;
+  std::vector<double> geometry_of_batches_;
+};
+void BatchedElementKernels::InitializeBatchedElementKernels(ElementGeometryCache *const element_geometry_cache){
+  element_geometry_cache_=element_geometry_cache;
+  num_of_integration_points_=(*element_geometry_cache).get_num_of_integration_points();
+  element_numbers_in_batches_.clear();
+  num_of_lanes_in_batches_.clear();
+  geometry_of_batches_.clear();
+}
+
+int BatchedElementKernels::AddBatch(std::vector<int>& element_numbers){
+  int batch_number=num_of_lanes_in_batches_.size();
+  int num_of_lanes=element_numbers.size();
+  num_of_lanes_in_batches_.push_back(num_of_lanes);
+  for(int lane=0;lane<kBatchWidth_;lane++)
+    element_numbers_in_batches_.push_back(element_numbers[(lane<num_of_lanes)?lane:num_of_lanes-1]);
+
+  geometry_of_batches_.resize((batch_number+1)*num_of_integration_points_*kGeometryPerIntegrationPoint_, 0.0);
+  double* geometry=&geometry_of_batches_[batch_number*num_of_integration_points_*kGeometryPerIntegrationPoint_];
+  for(int q=0;q<num_of_integration_points_;q++){
+    double* geometry_of_point=geometry+q*kGeometryPerIntegrationPoint_;
+    for(int lane=0;lane<kBatchWidth_;lane++){
+      int element_number=element_numbers_in_batches_[batch_number*kBatchWidth_+lane];
+      const double* shape_function=(*element_geometry_cache_).get_shape_function(element_number, q);
+      const double* dn_dx=(*element_geometry_cache_).get_dn_dx(element_number, q);
+      for(int a=0;a<4;a++){
+        geometry_of_point[a*kBatchWidth_+lane]=shape_function[a];
+        geometry_of_point[(4+a)*kBatchWidth_+lane]=dn_dx[a];
+        geometry_of_point[(8+a)*kBatchWidth_+lane]=dn_dx[4+a];
+      }
+      geometry_of_point[12*kBatchWidth_+lane]=(*element_geometry_cache_).get_determinant_times_weight(element_number, q);
+    }
+  }
+  return batch_number;
+}
+
+// nodal_temperatures is [4][kBatchWidth_]; element_stiffness_matrices and element_mass_matrices are [16][kBatchWidth_]
+void BatchedElementKernels::ComputeConductionAndCapacity(const int batch_number, const double* nodal_temperatures, 
+const double* conductivity_coefficients, const double* specific_heat_coefficients, const double density_over_time_increment, 
+double* element_stiffness_matrices, double* element_mass_matrices){
+  const double* geometry=&geometry_of_batches_[batch_number*num_of_integration_points_*kGeometryPerIntegrationPoint_];
+  SimdDouble conductivity[3], specific_heat[3];
+  for(int m=0;m<3;m++){
+    conductivity[m]=SimdBroadcast(conductivity_coefficients[m]);
+    specific_heat[m]=SimdBroadcast(specific_heat_coefficients[m]*density_over_time_increment);
+  }
+
+  for(int first_lane=0;first_lane<kBatchWidth_;first_lane+=kSimdWidth){
+    SimdDouble temperatures[4];
+    for(int a=0;a<4;a++)
+      temperatures[a]=SimdLoad(nodal_temperatures+a*kBatchWidth_+first_lane);
+    SimdDouble stiffness[4][4], mass[4][4];
+    for(int i=0;i<4;i++){
+      for(int j=i;j<4;j++){
+        stiffness[i][j]=SimdBroadcast(0.0);
+        mass[i][j]=SimdBroadcast(0.0);
+      }
+    }
+
+    for(int q=0;q<num_of_integration_points_;q++){
+      const double* geometry_of_point=geometry+q*kGeometryPerIntegrationPoint_+first_lane;
+      SimdDouble shape_function[4], dn_dx[4], dn_dy[4];
+      SimdDouble temperature=SimdBroadcast(0.0);
+      for(int a=0;a<4;a++){
+        shape_function[a]=SimdLoad(geometry_of_point+a*kBatchWidth_);
+        dn_dx[a]=SimdLoad(geometry_of_point+(4+a)*kBatchWidth_);
+        dn_dy[a]=SimdLoad(geometry_of_point+(8+a)*kBatchWidth_);
+        temperature=SimdMultiplyAdd(shape_function[a], temperatures[a], temperature);
+      }
+      SimdDouble determinant_times_weight=SimdLoad(geometry_of_point+12*kBatchWidth_);
+      //c0+c1*T+c2*T^2 in horner form
+      SimdDouble conductivity_times_weight=SimdMultiply(SimdMultiplyAdd(SimdMultiplyAdd(conductivity[2], temperature, conductivity[1]), 
+        temperature, conductivity[0]), determinant_times_weight);
+      SimdDouble capacity_times_weight=SimdMultiply(SimdMultiplyAdd(SimdMultiplyAdd(specific_heat[2], temperature, specific_heat[1]), 
+        temperature, specific_heat[0]), determinant_times_weight);
+      for(int i=0;i<4;i++){
+        SimdDouble weighted_dn_dx=SimdMultiply(conductivity_times_weight, dn_dx[i]);
+        SimdDouble weighted_dn_dy=SimdMultiply(conductivity_times_weight, dn_dy[i]);
+        SimdDouble weighted_shape_function=SimdMultiply(capacity_times_weight, shape_function[i]);
+        for(int j=i;j<4;j++){
+          stiffness[i][j]=SimdMultiplyAdd(weighted_dn_dx, dn_dx[j], SimdMultiplyAdd(weighted_dn_dy, dn_dy[j], stiffness[i][j]));
+          mass[i][j]=SimdMultiplyAdd(weighted_shape_function, shape_function[j], mass[i][j]);
+        }
+      }
+    }
+
+    for(int i=0;i<4;i++){
+      for(int j=i;j<4;j++){
+        SimdStore(element_stiffness_matrices+(i*4+j)*kBatchWidth_+first_lane, stiffness[i][j]);
+        SimdStore(element_stiffness_matrices+(j*4+i)*kBatchWidth_+first_lane, stiffness[i][j]);
+        SimdStore(element_mass_matrices+(i*4+j)*kBatchWidth_+first_lane, mass[i][j]);
+        SimdStore(element_mass_matrices+(j*4+i)*kBatchWidth_+first_lane, mass[i][j]);
+      }
+    }
+  }
+}
+
+
+// Material properties come from MaterialPropertyTable lookups. The built-in quadratic fits below are the defaults; an optional
+// material_property_tables.txt in the working directory replaces any of them with measured curves, one block per property:
+//   <thermal_conductivity|specific_heat|emissivity|resistivity> <material id, ignored for emissivity/resistivity> <num of samples>
+//   <temperature K> <value>   (num of samples lines, increasing temperature, units of the built-in fits)
 class TemperatureDependentVariables{
 public:
   void InitializeTemperatureDependentVariables(Initialization *const);
@@ -921,99 +1679,165 @@ public:
   double get_thermal_conductivity_derivative(int, double, std::vector<int>&);
   double get_body_heat_flux(double, double);
   double get_body_heat_flux_derivative(double, double);
+  void get_body_heat_flux_and_derivative(double, double, double&, double&);
   double get_heater_crosssection_area() const
     {return heater_crosssection_area_mm_square_;}
   double get_specific_heat(int, double, std::vector<int>&);
+  const MaterialPropertyTable& get_thermal_conductivity_table(const int material_id) const
+    {return thermal_conductivity_tables_[material_id];}
+  const MaterialPropertyTable& get_specific_heat_table(const int material_id) const
+    {return specific_heat_tables_[material_id];}
+  const double* get_thermal_conductivity_coefficients(const int material_id) const  //{constant, linear, quadratic}
+    {return thermal_conductivity_tables_[material_id].get_quadratic_coefficients();}
+  const double* get_specific_heat_coefficients(const int material_id) const
+    {return specific_heat_tables_[material_id].get_quadratic_coefficients();}
+  bool is_conductivity_and_specific_heat_quadratic() const;
   double get_emissivity(double); 
   double get_emissivity_derivative(double);
+  void get_emissivity_and_derivative(double, double&, double&);
   double get_heater_crosssection_area_mm_square() const
     {return heater_crosssection_area_mm_square_;}
   void PrintTemperatureDependentVariables(std::vector<int>&,Initialization *const);
  
 private:
+  void ReadPropertyTables();
+  static const double kThermalConductivityCoefficients_[4][3];
+  static const double kSpecificHeatCoefficients_[4][3];
+  static const double kEmissivityCoefficients_[3];
+  static const double kResistivityCoefficients_[3];
   double heater_crosssection_area_mm_square_;
+  double joule_heating_factor_;  //(1/A)^2 with unit conversions, body heat flux = factor*current^2*resistivity
+  std::vector<MaterialPropertyTable> thermal_conductivity_tables_;
+  std::vector<MaterialPropertyTable> specific_heat_tables_;
+  MaterialPropertyTable emissivity_table_;
+  MaterialPropertyTable resistivity_table_;
 };
+//quadratic fits c0+c1*T+c2*T^2, rows are material ids: csilicon, titanium, silicondioxide, copper
+const double TemperatureDependentVariables::kThermalConductivityCoefficients_[4][3]={
+  {295.9, -0.5435, 0.0002723},
+  {22.72, -0.01653, 1.375e-05},
+  {24.24, -0.06094, 4.8e-05},
+  {405.6987, -0.05699, -9.085e-06}};
+const double TemperatureDependentVariables::kSpecificHeatCoefficients_[4][3]={ //Cal/g/K = 4.184e9 mJ/tonne/K
+  {5.189e+8, 9.952e+5, -632.6},
+  {7.128e+8, -6.233e+5, 714.2},
+  {3.903e+8, 1.404e+6, -437.4},
+  {4.175e+8, -1.723e+5, 180.2}};
+//copper, data from curve 52 P148
+const double TemperatureDependentVariables::kEmissivityCoefficients_[3]={0.07681, 0.0003696, -1.932e-7};
+//titanium heater, ohm*m, data from
+//Bel'skaya, E. A. "An experimental investigation of the electrical resistivity of titanium in the temperature range from 77 to 1600 K." High Temperature 43.4 (2005): 546-553.
+const double TemperatureDependentVariables::kResistivityCoefficients_[3]={-2.831e-6, 1.037e-8, 1.403e-15};
+
 void TemperatureDependentVariables::InitializeTemperatureDependentVariables(Initialization *const initialization){
   heater_crosssection_area_mm_square_=(*((*initialization).get_model_geometry())).get_thickness_of_titanium()
                                       *(*((*initialization).get_model_geometry())).get_width_of_heater();
+  double heater_crosssection_area_m_square=heater_crosssection_area_mm_square_*1.0e-3*1.0e-3;  //mm^2->m^2
+  //mA -> A, and the final 1.0e-6 to the model units
+  joule_heating_factor_=1.0e-3*1.0e-3/(heater_crosssection_area_m_square*heater_crosssection_area_m_square)*1.0e-6;
+
+  thermal_conductivity_tables_.resize(Constants::kNumOfMaterials_);
+  specific_heat_tables_.resize(Constants::kNumOfMaterials_);
+  for(int i=0;i<Constants::kNumOfMaterials_;i++){
+    thermal_conductivity_tables_[i].InitializeFromPolynomial(kThermalConductivityCoefficients_[i], 3);
+    specific_heat_tables_[i].InitializeFromPolynomial(kSpecificHeatCoefficients_[i], 3);
+  }
+  emissivity_table_.InitializeFromPolynomial(kEmissivityCoefficients_, 3);
+  resistivity_table_.InitializeFromPolynomial(kResistivityCoefficients_, 3);
+  ReadPropertyTables();
 }
 
-double TemperatureDependentVariables::get_thermal_conductivity(const int element_number, const double temperature, std::vector<int>& material_id_of_elements){
-  double conductivity;
-  int material_id=material_id_of_elements[element_number];
-  switch(material_id){
-    case 0: conductivity=0.0002723*temperature*temperature-0.5435*temperature+295.9; break; //csilicon
-    case 1: conductivity=1.375e-05*temperature*temperature-0.01653*temperature+22.72; break;  //titanium
-    case 2: conductivity=4.8e-05*temperature*temperature-0.06094*temperature+24.24; break; //silicondioxide
-    case 3: conductivity=-9.085e-06*temperature*temperature-0.05699*temperature+405.6987; break; // copper
+void TemperatureDependentVariables::ReadPropertyTables(){
+  std::ifstream ifs("material_property_tables.txt", std::ios::in);
+  if(!ifs) return;
+  std::string property_name;
+  int material_id, num_of_samples;
+  while(ifs>>property_name>>material_id>>num_of_samples){
+    if(num_of_samples<1){
+      printf("material_property_tables.txt: incomplete table for %s\n", property_name.c_str());
+      exit(-1);
+    }
+    std::vector<double> temperatures(num_of_samples), values(num_of_samples);
+    for(int i=0;i<num_of_samples;i++)
+      ifs>>temperatures[i]>>values[i];
+    if(!ifs){
+      printf("material_property_tables.txt: incomplete table for %s\n", property_name.c_str());
+      exit(-1);
+    }
+    bool is_per_material=(property_name=="thermal_conductivity" || property_name=="specific_heat");
+    if(is_per_material && (material_id<0 || material_id>=Constants::kNumOfMaterials_)){
+      printf("material_property_tables.txt: material id %d out of range for %s\n", material_id, property_name.c_str());
+      exit(-1);
+    }
+    bool is_valid_table;
+    if(property_name=="thermal_conductivity") is_valid_table=thermal_conductivity_tables_[material_id].InitializeFromSamples(temperatures, values);
+    else if(property_name=="specific_heat") is_valid_table=specific_heat_tables_[material_id].InitializeFromSamples(temperatures, values);
+    else if(property_name=="emissivity") is_valid_table=emissivity_table_.InitializeFromSamples(temperatures, values);
+    else if(property_name=="resistivity") is_valid_table=resistivity_table_.InitializeFromSamples(temperatures, values);
+    else{
+      printf("material_property_tables.txt: unknown property %s\n", property_name.c_str());
+      exit(-1);
+    }
+    if(!is_valid_table){
+      printf("material_property_tables.txt: temperatures not strictly increasing in table for %s\n", property_name.c_str());
+      exit(-1);
+    }
+    if(is_per_material) printf("%s of material %d taken from material_property_tables.txt\n", property_name.c_str(), material_id);
+    else printf("%s taken from material_property_tables.txt\n", property_name.c_str());
   }
-  return conductivity;
+}
+
+bool TemperatureDependentVariables::is_conductivity_and_specific_heat_quadratic() const{
+  for(int i=0;i<Constants::kNumOfMaterials_;i++)
+    if(!thermal_conductivity_tables_[i].is_quadratic() || !specific_heat_tables_[i].is_quadratic()) return false;
+  return true;
+}
+
+double TemperatureDependentVariables::get_thermal_conductivity(const int element_number, const double temperature, std::vector<int>& material_id_of_elements){
+  return thermal_conductivity_tables_[material_id_of_elements[element_number]].Evaluate(temperature);
 }
 
 double TemperatureDependentVariables::get_thermal_conductivity_derivative(const int element_number, const double temperature, std::vector<int>& material_id_of_elements){
-  double conductivity_derivative;
-  int material_id=material_id_of_elements[element_number];
-  switch(material_id){
-    case 0: conductivity_derivative=0.0002723*2*temperature-0.5435; break; 
-    case 1: conductivity_derivative=1.375e-05*2*temperature-0.01653; break;
-    case 2: conductivity_derivative=4.8e-05*2*temperature-0.06094; break; 
-    case 3: conductivity_derivative=-9.085e-06*2*temperature-0.05699; break;
-  }
-  return conductivity_derivative;
+  double thermal_conductivity, thermal_conductivity_derivative;
+  thermal_conductivity_tables_[material_id_of_elements[element_number]].Evaluate(temperature, thermal_conductivity, 
+    thermal_conductivity_derivative);
+  return thermal_conductivity_derivative;
 }
 
 double TemperatureDependentVariables::get_specific_heat(const int element_number, const double temperature, std::vector<int>& material_id_of_elements){ //Cal/g/K = 4.184e9 mJ/tonne/K
-  double specific_heat;
-  int material_id=material_id_of_elements[element_number];
-  switch(material_id){
-    case 0: specific_heat=-632.6*temperature*temperature+9.952e+5*temperature+5.189e+8; break;//csilicon
-    case 1: specific_heat=714.2*temperature*temperature-6.233e+5*temperature+7.128e+8; break;//titanium
-    case 2: specific_heat=-437.4*temperature*temperature+1.404e+6*temperature+3.903e+8; break; //silicondioxide
-    case 3: specific_heat=180.2*temperature*temperature-1.723e+5*temperature+4.175e+8; break;// copper
-  }
-  return specific_heat;
+  return specific_heat_tables_[material_id_of_elements[element_number]].Evaluate(temperature);
+}
+
+void TemperatureDependentVariables::get_emissivity_and_derivative(const double temperature, double& emissivity, double& emissivity_derivative){
+  emissivity_table_.Evaluate(temperature, emissivity, emissivity_derivative);
 }
 
-double TemperatureDependentVariables::get_emissivity(const double temperature){ //Cal/g/K = 4.184e9 mJ/tonne/K    
-//data from curve 52 P148
-  double emissivity;
-  emissivity=-1.932e-7*temperature*temperature+0.0003696*temperature+0.07681;// copper
-  return emissivity;
+double TemperatureDependentVariables::get_emissivity(const double temperature){
+  return emissivity_table_.Evaluate(temperature);
 }
 
-double TemperatureDependentVariables::get_emissivity_derivative(const double temperature){ //Cal/g/K = 4.184e9 mJ/tonne/K    
-//data from curve 52 P148
-  double emissivity_derivative;
-  emissivity_derivative=-1.932e-7*2*temperature+0.0003696;// copper
+double TemperatureDependentVariables::get_emissivity_derivative(const double temperature){
+  double emissivity, emissivity_derivative;
+  emissivity_table_.Evaluate(temperature, emissivity, emissivity_derivative);
   return emissivity_derivative;
 }
 
+void TemperatureDependentVariables::get_body_heat_flux_and_derivative(const double temperature, const double current_in_element_ma, 
+double& body_heat_flux, double& body_heat_flux_derivative){
+  double resistivity, resistivity_derivative;
+  resistivity_table_.Evaluate(temperature, resistivity, resistivity_derivative);
+  double current_factor=joule_heating_factor_*current_in_element_ma*current_in_element_ma;
+  body_heat_flux=resistivity*current_factor;
+  body_heat_flux_derivative=resistivity_derivative*current_factor;
+}
 
-double TemperatureDependentVariables::get_body_heat_flux(const double temperature, const double current_in_element_ma){ //Cal/g/K = 4.184e9 mJ/tonne/K    
-//data from 
-//Bel’skaya, E. A. "An experimental investigation of the electrical resistivity of titanium in the temperature range from 77 to 1600 K." High Temperature 43.4 (2005): 546-553.
-//---------------------
-  double body_heat_flux;
-  double resistivity;
-  double current_in_element_a = current_in_element_ma*1.0e-3;  // mA -> A
-  double heater_crosssection_area_m_square=heater_crosssection_area_mm_square_*1.0e-3*1.0e-3;  //mm^2->m^2
-  resistivity = 1.403e-15*temperature*temperature + 1.037e-8*temperature - 2.831e-6;// titanium heater
-  body_heat_flux = resistivity*pow((current_in_element_a/heater_crosssection_area_m_square),2);
-  body_heat_flux *= 1.0e-6;
-  return body_heat_flux;
-}
-
-double TemperatureDependentVariables::get_body_heat_flux_derivative(const double temperature, const double current_in_element_ma){ //Cal/g/K = 4.184e9 mJ/tonne/K    
-//data from 
-//Bel’skaya, E. A. "An experimental investigation of the electrical resistivity of titanium in the temperature range from 77 to 1600 K." High Temperature 43.4 (2005): 546-553.
-//---------------------
-  double resistivity_derivative;
-  double body_heat_flux_derivative;
-  double current_in_element_a=current_in_element_ma*1.0e-3;
-  double heater_crosssection_area_m_square=heater_crosssection_area_mm_square_*1.0e-3*1.0e-3;  //mm^2->m^2
-  resistivity_derivative=1.403e-15*2*temperature+1.037e-8;// titanium heater
-  body_heat_flux_derivative = resistivity_derivative*pow((current_in_element_a/heater_crosssection_area_m_square),2);
-  body_heat_flux_derivative *= 1.0e-6;
+double TemperatureDependentVariables::get_body_heat_flux(const double temperature, const double current_in_element_ma){
+  return resistivity_table_.Evaluate(temperature)*joule_heating_factor_*current_in_element_ma*current_in_element_ma;
+}
+
+double TemperatureDependentVariables::get_body_heat_flux_derivative(const double temperature, const double current_in_element_ma){
+  double body_heat_flux, body_heat_flux_derivative;
+  get_body_heat_flux_and_derivative(temperature, current_in_element_ma, body_heat_flux, body_heat_flux_derivative);
   return body_heat_flux_derivative;
 }
 
@@ -1041,7 +1865,7 @@ public:
   std::vector<int> &get_elements_as_heater() 
     {return elements_as_heater_;}
   void HeatSupply(int, int, std::vector<double>&, std::vector<int>&,std::vector<int>&, std::vector<double>&,   
-  TemperatureDependentVariables*,Initialization *const);
+  TemperatureDependentVariables*,Initialization *const, ElementGeometryCache*const);
   void PrintHeaterElements(){
     for(int i=0;i<num_of_elements_as_heater_;i++)
       printf("elements_as_heater_[%d] = %d\n", i, elements_as_heater_[i]);
@@ -1071,39 +1895,26 @@ void HeaterElements::set_elements_as_heater(Initialization *const initialization
   }
 }
 
-void HeaterElements::HeatSupply(const int element_number, const int heater_element_number, std::vector<double>&heat_load, std::vector<int>&nodes_in_elements, std::vector<int>&equation_numbers_in_elements, std::vector<double>&current_temperature_field, TemperatureDependentVariables *const temperature_dependent_variables,Initialization *const initialization){//Calculate internal load contribution      
-  //integration rule
-  int num_of_integration_points=2;
-  double coordinates_of_integration_points[2]={-0.57735026, 0.57735026}; //gaussian quadrature coordinates
-  double weights_of_integration_points[2]={1.0, 1.0};//weight of gaussian point
-  
+void HeaterElements::HeatSupply(const int element_number, const int heater_element_number, std::vector<double>&heat_load, std::vector<int>&nodes_in_elements, std::vector<int>&equation_numbers_in_elements, std::vector<double>&current_temperature_field, TemperatureDependentVariables *const temperature_dependent_variables,Initialization *const initialization, ElementGeometryCache *const element_geometry_cache){//Calculate internal load contribution      
   int heater_number=heater_element_number/(*((*initialization).get_mesh_parameters())).get_mesh_seeds_on_heater();
   double current=(*((*initialization).get_currents_in_heater())).get_current_in_heater()[heater_number];
 
-  for(int k=0;k<num_of_integration_points;k++){
-    double ksi_coordinate=coordinates_of_integration_points[k];  //gaussian piont coordinate
-    double ksi_weight=weights_of_integration_points[k];    //weight of gaussian quadrature
-    for(int l=0;l<num_of_integration_points;l++){
-      double eta_coordinate=coordinates_of_integration_points[l]; 
-      double eta_weight=weights_of_integration_points[l];  
-
-      set_shape_function(ksi_coordinate, eta_coordinate);
-      set_shape_function_derivatives(ksi_coordinate, eta_coordinate);
-      set_determinant_of_jacobian_matrix();  
+  for(int q=0;q<(*element_geometry_cache).get_num_of_integration_points();q++){
+    const double* shape_function=(*element_geometry_cache).get_shape_function(element_number, q);
+    double determinant_times_weight=(*element_geometry_cache).get_determinant_times_weight(element_number, q);
 
-      double temperature=0.0;
-      for(int ii=0;ii<Constants::kNumOfNodesInElement_;ii++)
-        temperature += current_temperature_field[(nodes_in_elements[ii+element_number*4])]*shape_function_[ii];
+    double temperature=0.0;
+    for(int ii=0;ii<Constants::kNumOfNodesInElement_;ii++)
+      temperature += current_temperature_field[(nodes_in_elements[ii+element_number*4])]*shape_function[ii];
+    double body_heat_flux=(*temperature_dependent_variables).get_body_heat_flux(temperature,current)*determinant_times_weight;
 
-      for(int j=0;j<Constants::kNumOfNodesInElement_;j++){
-        double equation_number=equation_numbers_in_elements[j+element_number*4];
-        if(equation_number>=0){
-          heat_load[equation_number] += shape_function_[j]*
-          (*temperature_dependent_variables).get_body_heat_flux(temperature,current)*determinant_of_jacobian_matrix_*ksi_weight*eta_weight;
-        }//if
-      }//for j
-    }//for l
-  }//for k
+    for(int j=0;j<Constants::kNumOfNodesInElement_;j++){
+      int equation_number=equation_numbers_in_elements[j+element_number*4];
+      if(equation_number>=0){
+        heat_load[equation_number] += shape_function[j]*body_heat_flux;
+      }//if
+    }//for j
+  }//for q
 //  printf("processing heat supply element completed\n");
 }
 
@@ -1281,21 +2092,17 @@ public:
   void PrintDeterminantOfJacobianMatrix();
 
 protected:
-  std::vector<std::vector<double> > coordinates_in_this_element_;
-  std::vector<double> shape_function_;
-  std::vector<std::vector<double> > shape_function_derivatives_;
+  std::array<QuadElementVector, 2> coordinates_in_this_element_;
+  QuadElementVector shape_function_;
+  std::array<QuadElementVector, 2> shape_function_derivatives_;
   double determinant_of_jacobian_matrix_;
 };
 void IntegrationOverEdge::InitializeIntegrationOverEdge(){
-  coordinates_in_this_element_.resize(2);
-  coordinates_in_this_element_[0].resize(Constants::kNumOfNodesInElement_, 0.0);
-  coordinates_in_this_element_[1].resize(Constants::kNumOfNodesInElement_, 0.0);
-  
-  shape_function_.resize(Constants::kNumOfNodesInElement_, 0.0);
-   
-  shape_function_derivatives_.resize(2);
-  shape_function_derivatives_[0].resize(Constants::kNumOfNodesInElement_, 0.0);
-  shape_function_derivatives_[1].resize(Constants::kNumOfNodesInElement_, 0.0);
+  shape_function_.fill(0.0);
+  for(int v=0;v<2;v++){
+    coordinates_in_this_element_[v].fill(0.0);
+    shape_function_derivatives_[v].fill(0.0);
+  }
 }
 
 void IntegrationOverEdge::EdgeIntegration(const int element_number, const double ksi_coordinate, std::vector<double>& x_coordinates, std::vector<int>& nodes_in_elements){
@@ -1347,82 +2154,43 @@ void IntegrationOverEdge::PrintDeterminantOfJacobianMatrix(){
 class ElementalStiffnessMatrix:public MappingShapeFunctionAndDerivatives{
 public:
   void InitializeElementalStiffnessMatrix();
-  void set_element_stiffness_matrix(int, std::vector<int>&, std::vector<int>&, std::vector<double>&, TemperatureDependentVariables*);
-  void MapElementalToGlobalStiffness(std::vector<double>&, std::vector<int>&,std::vector<int>&, int);
-  std::vector<std::vector<double> >& get_element_stiffness_matrix(){return element_stiffness_matrix_;}
+  void set_element_stiffness_matrix(int, std::vector<int>&, std::vector<int>&, std::vector<double>&, TemperatureDependentVariables*, 
+  ElementGeometryCache*const);
+  void MapElementalToGlobalStiffness(std::vector<double>&, const int*);
+  void set_element_stiffness_matrix(const QuadElementMatrix&);
+  QuadElementMatrix& get_element_stiffness_matrix(){return element_stiffness_matrix_;}
   void PrintStiffnessMatrix(std::vector<double>&);
 
 private:
-  std::vector<std::vector<double> > element_stiffness_matrix_;
+  QuadElementMatrix element_stiffness_matrix_;
 };
 void ElementalStiffnessMatrix::InitializeElementalStiffnessMatrix(){
-  element_stiffness_matrix_.resize(Constants::kNumOfNodesInElement_);
   for(int i=0;i<Constants::kNumOfNodesInElement_;i++){
-    element_stiffness_matrix_[i].resize(Constants::kNumOfNodesInElement_,0.0);
+    element_stiffness_matrix_[i].fill(0.0);
   }
   InitializeMappingShapeFunctionAndDerivatives();
 }
 
-void ElementalStiffnessMatrix::set_element_stiffness_matrix(const int element_number, std::vector<int>&nodes_in_elements, std::vector<int>& material_id_of_elements, std::vector<double>& current_temperature_field, TemperatureDependentVariables *const temperature_dependent_variables){
-
-  //----------------integration rule------------------
-  int num_of_integration_points = 3;
-  double coordinates_of_integration_points[3]={-0.7745966692, 0, 0.7745966692}; //gaussian quadrature coordinates
-  double weights_of_integration_points[3]={0.5555555555, 0.8888888888, 0.5555555555};//weight of gaussian point
-
-  //---------zero out element K   matrix--------------
-  for(int i=0;i<Constants::kNumOfNodesInElement_;i++){
-    for(int j=0;j<Constants::kNumOfNodesInElement_;j++){
-      element_stiffness_matrix_[i][j]=0.0;
-    }
-  }
-
-  for(int i=0;i<Constants::kNumOfNodesInElement_;i++){ 
-    for(int j=0;j<Constants::kNumOfNodesInElement_;j++){
-
-      for(int k=0;k<num_of_integration_points;k++){
-        double ksi_coordinate = coordinates_of_integration_points[k];  //gaussian piont coordinate
-        double ksi_weight = weights_of_integration_points[k];    //weight of gaussian quadrature
-
-        for(int l=0;l<num_of_integration_points;l++){
-          double eta_coordinate = coordinates_of_integration_points[l]; 
-          double eta_weight = weights_of_integration_points[l];    
-
-          set_shape_function(ksi_coordinate, eta_coordinate);
-          set_shape_function_derivatives(ksi_coordinate, eta_coordinate);
-          set_determinant_of_jacobian_matrix();  
-          set_dn_dx();
-
-          double dni_x=dn_dx_[0][i];
-          double dni_y=dn_dx_[1][i];
-          double dnj_x=dn_dx_[0][j];
-          double dnj_y=dn_dx_[1][j];
+void ElementalStiffnessMatrix::set_element_stiffness_matrix(const int element_number, std::vector<int>&nodes_in_elements, std::vector<int>& material_id_of_elements, std::vector<double>& current_temperature_field, TemperatureDependentVariables *const temperature_dependent_variables, ElementGeometryCache *const element_geometry_cache){
+  QuadElementVector nodal_temperatures;
+  for(int ii=0;ii<Constants::kNumOfNodesInElement_;ii++)
+    nodal_temperatures[ii]=current_temperature_field[nodes_in_elements[ii+element_number*Constants::kNumOfNodesInElement_]];
 
-          double nx_nx = dni_x*dnj_x*determinant_of_jacobian_matrix_*ksi_weight*eta_weight;
-          double ny_ny = dni_y*dnj_y*determinant_of_jacobian_matrix_*ksi_weight*eta_weight;
-
-          double temperature = 0.0;
-          for(int ii=0;ii<Constants::kNumOfNodesInElement_;ii++){
-            temperature += current_temperature_field[(nodes_in_elements[ii+element_number*4])]*shape_function_[ii];
-          }
+  //----------------3x3 gauss rule, geometry taken from the cache------------------
+  IntegrateConduction<Constants::kNumOfNodesInElement_, GaussLegendreRule<3>::kNumOfTensorProductPoints_>(*element_geometry_cache, 
+    element_number, nodal_temperatures, (*temperature_dependent_variables).get_thermal_conductivity_table(material_id_of_elements[element_number]), 
+    element_stiffness_matrix_);
+}
 
-          element_stiffness_matrix_[i][j] += 
-          (*temperature_dependent_variables).get_thermal_conductivity(element_number, temperature, material_id_of_elements)*(nx_nx+ny_ny);
-        }
-      }
-    }
-  }
+void ElementalStiffnessMatrix::set_element_stiffness_matrix(const QuadElementMatrix& element_stiffness_matrix){
+  element_stiffness_matrix_=element_stiffness_matrix;
 }
 
-void ElementalStiffnessMatrix::MapElementalToGlobalStiffness(std::vector<double>&stiffness_matrix, std::vector<int>&accumulative_half_band_width_vector, std::vector<int>&equation_numbers_in_elements, const int element_number){
+void ElementalStiffnessMatrix::MapElementalToGlobalStiffness(std::vector<double>&stiffness_matrix, const int* storage_offsets){
   for(int i=0;i<Constants::kNumOfNodesInElement_;i++){
     for(int j=0;j<Constants::kNumOfNodesInElement_;j++){
-      int row_equation_number=equation_numbers_in_elements[i+element_number*Constants::kNumOfNodesInElement_];
-      int column_equation_number=equation_numbers_in_elements[j+element_number*Constants::kNumOfNodesInElement_];
-      if(row_equation_number>=0 && column_equation_number>=0 && column_equation_number<=row_equation_number){
-        int position_in_desparsed_matrix=accumulative_half_band_width_vector[row_equation_number]-(row_equation_number-column_equation_number);
-        stiffness_matrix[position_in_desparsed_matrix] += element_stiffness_matrix_[i][j];
-      }
+      int position_in_desparsed_matrix=storage_offsets[i*Constants::kNumOfNodesInElement_+j];
+      if(position_in_desparsed_matrix>=0) stiffness_matrix[position_in_desparsed_matrix] += element_stiffness_matrix_[i][j];
     }  
   }
 //printf("map to global stiffness matrix completed\n");
@@ -1438,73 +2206,43 @@ void ElementalStiffnessMatrix::PrintStiffnessMatrix(std::vector<double>&stiffnes
 class ElementalMassMatrix:public MappingShapeFunctionAndDerivatives{
 public:
   void InitializeElementalMassMatrix();
-  void set_element_mass_matrix(int, std::vector<int>&, std::vector<int>&, std::vector<double>&, TemperatureDependentVariables*, std::vector<double>&, double);
-  void MapElementalToGlobalMass(std::vector<double>&, std::vector<int>&, std::vector<int>&, int);
+  void set_element_mass_matrix(int, std::vector<int>&, std::vector<int>&, std::vector<double>&, TemperatureDependentVariables*, std::vector<double>&, double,
+  ElementGeometryCache*const);
+  void set_element_mass_matrix(const QuadElementMatrix&);
+  void MapElementalToGlobalMass(std::vector<double>&, const int*);
   void PrintMassMatrix(int, std::vector<double>&);
 
 private:
-  std::vector<std::vector<double> > element_mass_matrix_;
+  QuadElementMatrix element_mass_matrix_;
 };
 void ElementalMassMatrix::InitializeElementalMassMatrix(){
-  element_mass_matrix_.resize(Constants::kNumOfNodesInElement_);
   for(int i=0;i<Constants::kNumOfNodesInElement_;i++){
-    element_mass_matrix_[i].resize(Constants::kNumOfNodesInElement_,0.0);
+    element_mass_matrix_[i].fill(0.0);
   }
   InitializeMappingShapeFunctionAndDerivatives();
 }
 
-void ElementalMassMatrix::set_element_mass_matrix(const int element_number, std::vector<int>&nodes_in_elements, std::vector<int>& material_id_of_elements, std::vector<double>& current_temperature_field, TemperatureDependentVariables *const temperature_dependent_variables, std::vector<double> &densities, const double time_increment){
-  //----------------integration rule------------------
-  int num_of_integration_points = 3;
-  double coordinates_of_integration_points[3]={-0.7745966692, 0, 0.7745966692}; //gaussian quadrature coordinates
-  double weights_of_integration_points[3]={0.5555555555, 0.8888888888, 0.5555555555};//weight of gaussian point
-
-  //---------zero out element K   matrix--------------
-  for(int i=0;i<Constants::kNumOfNodesInElement_;i++){
-    for(int j=0;j<Constants::kNumOfNodesInElement_;j++){
-      element_mass_matrix_[i][j]=0.0;
-    }
-  }
-
-  for(int i=0;i<Constants::kNumOfNodesInElement_;i++){ 
-    for(int j=0;j<Constants::kNumOfNodesInElement_;j++){
-      for(int k=0;k<num_of_integration_points;k++){
-        double ksi_coordinate = coordinates_of_integration_points[k];  //gaussian piont coordinate
-        double ksi_weight = weights_of_integration_points[k];    //weight of gaussian quadrature
-
-        for(int l=0;l<num_of_integration_points;l++){
-          double eta_coordinate = coordinates_of_integration_points[l]; 
-          double eta_weight = weights_of_integration_points[l];    
-
-          set_shape_function(ksi_coordinate, eta_coordinate);
-          set_shape_function_derivatives(ksi_coordinate, eta_coordinate);
-          set_determinant_of_jacobian_matrix();  
-
-          double temperature = 0.0;
-          for(int ii=0;ii<Constants::kNumOfNodesInElement_;ii++){
-            temperature += current_temperature_field[(nodes_in_elements[ii+element_number*4])]*shape_function_[ii];
-          }
-
-          double density = densities[material_id_of_elements[element_number]];
+void ElementalMassMatrix::set_element_mass_matrix(const int element_number, std::vector<int>&nodes_in_elements, std::vector<int>& material_id_of_elements, std::vector<double>& current_temperature_field, TemperatureDependentVariables *const temperature_dependent_variables, std::vector<double> &densities, const double time_increment, ElementGeometryCache *const element_geometry_cache){
+  int material_id=material_id_of_elements[element_number];
+  QuadElementVector nodal_temperatures;
+  for(int ii=0;ii<Constants::kNumOfNodesInElement_;ii++)
+    nodal_temperatures[ii]=current_temperature_field[nodes_in_elements[ii+element_number*Constants::kNumOfNodesInElement_]];
+
+  //----------------3x3 gauss rule, geometry taken from the cache------------------
+  IntegrateCapacity<Constants::kNumOfNodesInElement_, GaussLegendreRule<3>::kNumOfTensorProductPoints_>(*element_geometry_cache, 
+    element_number, nodal_temperatures, (*temperature_dependent_variables).get_specific_heat_table(material_id), 
+    densities[material_id]/time_increment, element_mass_matrix_);
+}
 
-          element_mass_matrix_[i][j] += 
-          (*temperature_dependent_variables).get_specific_heat(element_number, temperature, material_id_of_elements)*density
-          /time_increment*shape_function_[i]*shape_function_[j]*determinant_of_jacobian_matrix_*ksi_weight*eta_weight;;
-        }
-      }
-    }
-  }
+void ElementalMassMatrix::set_element_mass_matrix(const QuadElementMatrix& element_mass_matrix){
+  element_mass_matrix_=element_mass_matrix;
 }
 
-void ElementalMassMatrix::MapElementalToGlobalMass(std::vector<double>&mass_matrix, std::vector<int>&accumulative_half_band_width_vector, std::vector<int>&equation_numbers_in_elements, const int element_number){
+void ElementalMassMatrix::MapElementalToGlobalMass(std::vector<double>&mass_matrix, const int* storage_offsets){
   for(int i=0;i<Constants::kNumOfNodesInElement_;i++){
     for(int j=0;j<Constants::kNumOfNodesInElement_;j++){
-      int row_equation_number=equation_numbers_in_elements[i+element_number*Constants::kNumOfNodesInElement_];
-      int column_equation_number=equation_numbers_in_elements[j+element_number*Constants::kNumOfNodesInElement_];
-      if(row_equation_number>=0 && column_equation_number>=0 && column_equation_number<=row_equation_number){
-        int position_in_desparsed_matrix=accumulative_half_band_width_vector[row_equation_number]-(row_equation_number-column_equation_number);
-        mass_matrix[position_in_desparsed_matrix] += element_mass_matrix_[i][j];
-      }
+      int position_in_desparsed_matrix=storage_offsets[i*Constants::kNumOfNodesInElement_+j];
+      if(position_in_desparsed_matrix>=0) mass_matrix[position_in_desparsed_matrix] += element_mass_matrix_[i][j];
     }  
   }
 //printf("map to global stiffness matrix completed\n");
@@ -1520,71 +2258,54 @@ class ElementalBodyHeatFluxTangentialMatrix:public MappingShapeFunctionAndDeriva
 public:
   void InitializeElementalBodyHeatFluxTangentialMatrix();
   void set_element_body_heat_flux_tangential_matrix(int, int, std::vector<int>&, std::vector<double>&, TemperatureDependentVariables*const, 
-    Initialization*const);
-  void MapElementalToGlobalBodyHeatFluxTangentialMatrix(std::vector<double>&, std::vector<int>&,std::vector<int>&, int);
+    Initialization*const, ElementGeometryCache*const);
+  void MapElementalToGlobalBodyHeatFluxTangentialMatrix(std::vector<double>&, const int*);
   void PrintBodyHeatFluxTangentialMatrix(std::vector<double>&);
 
 private:
-  std::vector<std::vector<double> > element_body_heat_flux_tangential_matrix_;
+  QuadElementMatrix element_body_heat_flux_tangential_matrix_;
 };
 void ElementalBodyHeatFluxTangentialMatrix::InitializeElementalBodyHeatFluxTangentialMatrix(){
-  element_body_heat_flux_tangential_matrix_.resize(Constants::kNumOfNodesInElement_);
   for(int i=0;i<Constants::kNumOfNodesInElement_;i++){
-    element_body_heat_flux_tangential_matrix_[i].resize(Constants::kNumOfNodesInElement_,0.0);
+    element_body_heat_flux_tangential_matrix_[i].fill(0.0);
   }
   InitializeMappingShapeFunctionAndDerivatives();
 }
 
-void ElementalBodyHeatFluxTangentialMatrix::set_element_body_heat_flux_tangential_matrix(const int element_number, const int heater_element_number, std::vector<int>&nodes_in_elements, std::vector<double>& current_temperature_field, TemperatureDependentVariables *const temperature_dependent_variables,Initialization *const initialization){
+void ElementalBodyHeatFluxTangentialMatrix::set_element_body_heat_flux_tangential_matrix(const int element_number, const int heater_element_number, std::vector<int>&nodes_in_elements, std::vector<double>& current_temperature_field, TemperatureDependentVariables *const temperature_dependent_variables,Initialization *const initialization, ElementGeometryCache *const element_geometry_cache){
   int heater_number=heater_element_number/(*((*initialization).get_mesh_parameters())).get_mesh_seeds_on_heater();
   double current=(*((*initialization).get_currents_in_heater())).get_current_in_heater()[heater_number];
 
-  //integration rule
-  int num_of_integration_points=2;
-  double coordinates_of_integration_points[2]={-0.57735026, 0.57735026}; //gaussian quadrature coordinates
-  double weights_of_integration_points[2]={1.0, 1.0};//weight of gaussian point
-
   //---------zero out element tangential body heat flux matrix--------------
   for(int i=0;i<Constants::kNumOfNodesInElement_;i++)
     for(int j=0;j<Constants::kNumOfNodesInElement_;j++)
       element_body_heat_flux_tangential_matrix_[i][j]=0.0;
   
-  //---------------------------------
-  for(int i=0;i<Constants::kNumOfNodesInElement_;i++){ 
-    for(int j=0;j<Constants::kNumOfNodesInElement_;j++){
-
-      for(int k=0;k<num_of_integration_points;k++){
-        double ksi_coordinate=coordinates_of_integration_points[k];  //gaussian piont coordinate
-        double ksi_weight=weights_of_integration_points[k];    //weight of gaussian quadrature
-        for(int l=0;l<num_of_integration_points;l++){
-          double eta_coordinate=coordinates_of_integration_points[l]; 
-          double eta_weight=weights_of_integration_points[l];  
+  //---------2x2 gauss rule, geometry taken from the cache------------------------
+  for(int q=0;q<(*element_geometry_cache).get_num_of_integration_points();q++){
+    const double* shape_function=(*element_geometry_cache).get_shape_function(element_number, q);
 
-          set_shape_function(ksi_coordinate, eta_coordinate);
-          set_shape_function_derivatives(ksi_coordinate, eta_coordinate);
-          set_determinant_of_jacobian_matrix();  
-      
-          double temperature=0.0;
-          for(int ii=0;ii<Constants::kNumOfNodesInElement_;ii++)
-            temperature += current_temperature_field[(nodes_in_elements[ii+element_number*4])]*shape_function_[ii];
+    double temperature=0.0;
+    for(int ii=0;ii<Constants::kNumOfNodesInElement_;ii++)
+      temperature += current_temperature_field[(nodes_in_elements[ii+element_number*4])]*shape_function[ii];
+    double flux_derivative_times_weight=(*temperature_dependent_variables).get_body_heat_flux_derivative(temperature,current)
+      *(*element_geometry_cache).get_determinant_times_weight(element_number, q);
 
-          element_body_heat_flux_tangential_matrix_[i][j] += (*temperature_dependent_variables).get_body_heat_flux_derivative
-          (temperature,current)*shape_function_[i]*shape_function_[j]*determinant_of_jacobian_matrix_*ksi_weight*eta_weight;
-        }
+    for(int i=0;i<Constants::kNumOfNodesInElement_;i++){ 
+      for(int j=0;j<Constants::kNumOfNodesInElement_;j++){
+        element_body_heat_flux_tangential_matrix_[i][j] += flux_derivative_times_weight*shape_function[i]*shape_function[j];
       }
     }  
   }
 }
 
-void ElementalBodyHeatFluxTangentialMatrix::MapElementalToGlobalBodyHeatFluxTangentialMatrix(std::vector<double>&body_heat_flux_tangential_matrix,std::vector<int>&accumulative_half_band_width_vector,std::vector<int>&equation_numbers_in_elements, const int element_number){
+void ElementalBodyHeatFluxTangentialMatrix::MapElementalToGlobalBodyHeatFluxTangentialMatrix(std::vector<double>&body_heat_flux_tangential_matrix, 
+const int* storage_offsets){
   for(int i=0;i<Constants::kNumOfNodesInElement_;i++){
     for(int j=0;j<Constants::kNumOfNodesInElement_;j++){
-      int row_equation_number=equation_numbers_in_elements[i+element_number*Constants::kNumOfNodesInElement_];
-      int column_equation_number=equation_numbers_in_elements[j+element_number*Constants::kNumOfNodesInElement_];
-      if(row_equation_number>=0 && column_equation_number>=0 && column_equation_number<=row_equation_number){
-        int position_in_desparsed_matrix=accumulative_half_band_width_vector[row_equation_number]-(row_equation_number-column_equation_number);
+      int position_in_desparsed_matrix=storage_offsets[i*Constants::kNumOfNodesInElement_+j];
+      if(position_in_desparsed_matrix>=0) 
         body_heat_flux_tangential_matrix[position_in_desparsed_matrix] += element_body_heat_flux_tangential_matrix_[i][j];
-      }
     }  
   }
 //printf("map to global stiffness matrix completed\n");
@@ -1602,27 +2323,26 @@ public:
   void InitializeElementalRadiationTangentialMatrixAndRadiationLoad();
   void set_element_radiation_tangential_matrix_and_radiation_load(int, int, std::vector<int>&, std::vector<double>&, 
   TemperatureDependentVariables*, std::vector<double>&, double);
-  void MapElementalToGlobalRadiationTangentialMatrixAndRadiationLoad(std::vector<double>&, std::vector<int>&, std::vector<double>&, 
+  void MapElementalToGlobalRadiationTangentialMatrixAndRadiationLoad(std::vector<double>&, const int*, std::vector<double>&, 
   std::vector<int>&, int);
   void PrintRadiationTangentialMatrixAndRadiationLoad(std::vector<double>&, std::vector<double>&);
+  QuadElementMatrix& get_element_radiation_tangential_matrix(){return element_radiation_tangential_matrix_;}
+  const double* get_local_radiation_load() const {return local_radiation_load;}
 
 private:
-  std::vector<std::vector<double> > element_radiation_tangential_matrix_;
+  QuadElementMatrix element_radiation_tangential_matrix_;
   double local_radiation_load[2];
 };
 void ElementalRadiationTangentialMatrixAndRadiationLoad::InitializeElementalRadiationTangentialMatrixAndRadiationLoad(){
-  element_radiation_tangential_matrix_.resize(Constants::kNumOfNodesInElement_);
   for(int i=0;i<Constants::kNumOfNodesInElement_;i++){
-    element_radiation_tangential_matrix_[i].resize(Constants::kNumOfNodesInElement_,0.0);
+    element_radiation_tangential_matrix_[i].fill(0.0);
   }
   InitializeIntegrationOverEdge();
 }
 
 void ElementalRadiationTangentialMatrixAndRadiationLoad::set_element_radiation_tangential_matrix_and_radiation_load(const int element_number, const int radiation_element_number, std::vector<int>&nodes_in_elements, std::vector<double>& current_temperature_field, TemperatureDependentVariables *const temperature_dependent_variables,std::vector<double>&x_coordinates, const double ambient_temperature){
   //integration rule 
-  int num_of_integration_points=4;
-  double coordinates_of_integration_points[4]={-0.861136312, -0.339981044, 0.339981044, 0.861136312}; //gaussian quadrature coordinates
-  double weights_of_integration_points[4]={0.347854845, 0.652145155, 0.652145155, 0.347854845};//weight of gaussian point
+  typedef GaussLegendreRule<4> EdgeRule;
 
   //---------zero out element Tangentialradiation matrix--------------
   for(int i=0;i<Constants::kNumOfNodesInElement_;i++){
@@ -1636,9 +2356,9 @@ void ElementalRadiationTangentialMatrixAndRadiationLoad::set_element_radiation_t
 
   double temperature_quartic_o=pow(ambient_temperature,4);
 
-  for(int k=0;k<num_of_integration_points;k++){
-    double ksi_coordinate=coordinates_of_integration_points[k];  //gaussian piont coordinate
-    double ksi_weight=weights_of_integration_points[k];    //weight of gaussian quadrature
+  for(int k=0;k<(int)EdgeRule::kCoordinates_.size();k++){
+    double ksi_coordinate=EdgeRule::kCoordinates_[k];  //gaussian piont coordinate
+    double ksi_weight=EdgeRule::kWeights_[k];    //weight of gaussian quadrature
     
     EdgeIntegration(element_number,ksi_coordinate, x_coordinates, nodes_in_elements);
 
@@ -1646,11 +2366,13 @@ void ElementalRadiationTangentialMatrixAndRadiationLoad::set_element_radiation_t
     temperature += current_temperature_field[(nodes_in_elements[2+element_number*4])]*shape_function_[0];
     temperature += current_temperature_field[(nodes_in_elements[3+element_number*4])]*shape_function_[1];
 
-    double temperature_cube=pow(temperature,3);
-    double temperature_quartic=pow(temperature,4);
+    double temperature_cube=temperature*temperature*temperature;
+    double temperature_quartic=temperature_cube*temperature;
     
-    double constant_a=Constants::kStefanBoltzmann_*(*temperature_dependent_variables).get_emissivity(temperature);
-    double constant_a_derivative=Constants::kStefanBoltzmann_*(*temperature_dependent_variables).get_emissivity_derivative(temperature);
+    double emissivity, emissivity_derivative;
+    (*temperature_dependent_variables).get_emissivity_and_derivative(temperature, emissivity, emissivity_derivative);
+    double constant_a=Constants::kStefanBoltzmann_*emissivity;
+    double constant_a_derivative=Constants::kStefanBoltzmann_*emissivity_derivative;
 
     double coefficient=4*constant_a*temperature_cube+constant_a_derivative*temperature_quartic;
 
@@ -1669,15 +2391,12 @@ void ElementalRadiationTangentialMatrixAndRadiationLoad::set_element_radiation_t
 }
 
 
-void ElementalRadiationTangentialMatrixAndRadiationLoad::MapElementalToGlobalRadiationTangentialMatrixAndRadiationLoad(std::vector<double>&radiation_tangential_matrix, std::vector<int>&accumulative_half_band_width_vector, std::vector<double>&radiation_load,std::vector<int>&equation_numbers_in_elements, const int element_number){
-  for(int i=0;i<Constants::kNumOfNodesInElement_;i++){
-    for(int j=0;j<Constants::kNumOfNodesInElement_;j++){
-      int row_equation_number=equation_numbers_in_elements[i+element_number*Constants::kNumOfNodesInElement_];
-      int column_equation_number=equation_numbers_in_elements[j+element_number*Constants::kNumOfNodesInElement_];
-      if(row_equation_number>=0 && column_equation_number>=0 && column_equation_number<=row_equation_number){
-        int position_in_desparsed_matrix=accumulative_half_band_width_vector[row_equation_number]-(row_equation_number-column_equation_number);
-        radiation_tangential_matrix[position_in_desparsed_matrix] += element_radiation_tangential_matrix_[i][j];
-      }
+void ElementalRadiationTangentialMatrixAndRadiationLoad::MapElementalToGlobalRadiationTangentialMatrixAndRadiationLoad(std::vector<double>&radiation_tangential_matrix, const int* storage_offsets, std::vector<double>&radiation_load,std::vector<int>&equation_numbers_in_elements, const int element_number){
+  //only the top edge (3rd and 4th node) carries radiation
+  for(int i=2;i<Constants::kNumOfNodesInElement_;i++){
+    for(int j=2;j<Constants::kNumOfNodesInElement_;j++){
+      int position_in_desparsed_matrix=storage_offsets[i*Constants::kNumOfNodesInElement_+j];
+      if(position_in_desparsed_matrix>=0) radiation_tangential_matrix[position_in_desparsed_matrix] += element_radiation_tangential_matrix_[i][j];
     }  
   }
   //map to radiation load
@@ -1718,12 +2437,16 @@ public:
     {return right_hand_side_function_;}
   std::vector<double>& get_jacobian_matrix_global()
     {return jacobian_matrix_global_;}
+  std::vector<double>& get_jacobian_upper_matrix_global()  //upper triangle by columns, only with the consistent tangent
+    {return jacobian_upper_matrix_global_;}
   std::vector<double>& get_solution_increments_trial()
     {return solution_increments_trial_;}
   std::vector<double>& get_initial_temperature_field()
     {return initial_temperature_field_;}
   std::vector<double>& get_solution_of_last_iteration()
     {return solution_of_last_iteration_;}
+  std::vector<int>& get_accumulative_half_band_width_vector()
+    {return accumulative_half_band_width_vector_;}
   void PrintGlobalVectorsAndMatrices(){
     for(int i=0;i<stiffness_matrix_.size();i++)
       printf("stffness_matrix_[%d] = %f\n", i, stiffness_matrix_[i]);
@@ -1736,6 +2459,8 @@ public:
   double BodyHeatFluxTangentialMatrixIndex(int, int);
   double JacobianMatrixIndex(int, int);
   int ModifyJacobianMatrixIndex(int, int, double);
+  void SymmetricBandedMatrixVectorProduct(std::vector<double>&, std::vector<double>&, std::vector<double>&, std::vector<double>&, 
+  std::vector<double>&);
   void ZeroVectorAndMatrix();
 
 private:
@@ -1748,6 +2473,7 @@ private:
   std::vector<double> current_temperature_field_;
   std::vector<double> right_hand_side_function_; //dGlobalyfunc
   std::vector<double> jacobian_matrix_global_;
+  std::vector<double> jacobian_upper_matrix_global_;
   std::vector<double> solution_increments_trial_;//dIterstep
   std::vector<double> initial_temperature_field_;
   std::vector<double> solution_of_last_iteration_;
@@ -1758,11 +2484,18 @@ private:
 void GlobalVectorsAndMatrices::InitializeGlobalVectorsAndMatrices(const int num_of_nodes, std::vector<int>&accumulative_half_band_width_vector){
   int num_of_equations = accumulative_half_band_width_vector.size();
   int size_of_desparsed_stiffness_matrix = accumulative_half_band_width_vector[num_of_equations-1]+1;
-  stiffness_matrix_.resize(size_of_desparsed_stiffness_matrix, 0.0);
-  mass_matrix_.resize(size_of_desparsed_stiffness_matrix, 0.0);
-  radiation_tangential_matrix_.resize(size_of_desparsed_stiffness_matrix, 0.0);
-  body_heat_flux_tangential_matrix_.resize(size_of_desparsed_stiffness_matrix, 0.0);
-  jacobian_matrix_global_.resize(size_of_desparsed_stiffness_matrix, 0.0);
+  if(!Constants::kUseFusedAssembly_){ //the fused assembly path writes the jacobian directly and needs no separate operators
+    stiffness_matrix_.resize(size_of_desparsed_stiffness_matrix, 0.0);
+    mass_matrix_.resize(size_of_desparsed_stiffness_matrix, 0.0);
+    radiation_tangential_matrix_.resize(size_of_desparsed_stiffness_matrix, 0.0);
+    body_heat_flux_tangential_matrix_.resize(size_of_desparsed_stiffness_matrix, 0.0);
+  }
+  if(Constants::kLinearSolverBackend_==2) //lagged preconditioner operator as one 9 point stencil per node
+    jacobian_matrix_global_.resize(9*num_of_nodes, 0.0);
+  else
+    jacobian_matrix_global_.resize(size_of_desparsed_stiffness_matrix, 0.0);
+  if(Constants::kUseConsistentTangent_) //column j of the upper triangle shares the profile of row j, A(i,j) at [j]-(j-i)
+    jacobian_upper_matrix_global_.resize(size_of_desparsed_stiffness_matrix, 0.0);
   heat_load_.resize(num_of_equations, 0.0);
   radiation_load_.resize(num_of_equations, 0.0);
   right_hand_side_function_.resize(num_of_equations, 0.0);
@@ -1834,18 +2567,54 @@ double GlobalVectorsAndMatrices::BodyHeatFluxTangentialMatrixIndex(const int i,
   return UseIndexToSearchDoubleSymmetricMatrix(&body_heat_flux_tangential_matrix_, i, j);
 }
 
-double GlobalVectorsAndMatrices::JacobianMatrixIndex(const int i, const int j){
+// lower_matrix holds the lower triangle by rows, upper_matrix the upper triangle by columns, both on the same profile
+double GlobalVectorsAndMatrices::UseIndexToSearchDoubleAsymmetricMatrix(std::vector<double>* lower_matrix, std::vector<double>* upper_matrix, 
+int i, int j){
+  if(j==num_of_equations_) return right_hand_side_function_[i];
+  if(j>i) return UseIndexToSearchDoubleSymmetricMatrix(upper_matrix, i, j);
+  return UseIndexToSearchDoubleSymmetricMatrix(lower_matrix, i, j);
+}
+
+double GlobalVectorsAndMatrices::JacobianMatrixIndex(const int i, const int j){
+  if(Constants::kUseConsistentTangent_)
+    return UseIndexToSearchDoubleAsymmetricMatrix(&jacobian_matrix_global_, &jacobian_upper_matrix_global_, i, j);
   return UseIndexToSearchDoubleSymmetricMatrix(&jacobian_matrix_global_, i, j);
 }
 
+// product=first_matrix*first_vector+second_matrix*second_vector for two symmetric matrices sharing the skyline profile. 
+// both matrices are streamed once: every stored lower entry (i,j) contributes to row i and, mirrored, to row j.
+void GlobalVectorsAndMatrices::SymmetricBandedMatrixVectorProduct(std::vector<double>& first_matrix, std::vector<double>& first_vector,
+std::vector<double>& second_matrix, std::vector<double>& second_vector, std::vector<double>& product){
+  for(int i=0; i<num_of_equations_; i++)
+    product[i]=0.0;
+  for(int i=0; i<num_of_equations_; i++){
+    int offset_of_row_i=accumulative_half_band_width_vector_[i]-i;
+    int first_column=(i==0)?0:i-(accumulative_half_band_width_vector_[i]-accumulative_half_band_width_vector_[i-1])+1;
+    double first_component_i=first_vector[i];
+    double second_component_i=second_vector[i];
+    double summation=first_matrix[accumulative_half_band_width_vector_[i]]*first_component_i
+                    +second_matrix[accumulative_half_band_width_vector_[i]]*second_component_i;
+    for(int j=first_column; j<i; j++){
+      double first_entry=first_matrix[offset_of_row_i+j];
+      double second_entry=second_matrix[offset_of_row_i+j];
+      summation += first_entry*first_vector[j]+second_entry*second_vector[j];
+      product[j] += first_entry*first_component_i+second_entry*second_component_i;
+    }
+    product[i] += summation;
+  }
+}
+
 void GlobalVectorsAndMatrices::ZeroVectorAndMatrix(){
   for(int i=0; i<stiffness_matrix_.size(); i++){
     stiffness_matrix_[i]=0.0;
     mass_matrix_[i]=0.0;
     radiation_tangential_matrix_[i]=0.0;
     body_heat_flux_tangential_matrix_[i]=0.0;
-    jacobian_matrix_global_[i]=0.0;
   }
+  for(int i=0; i<jacobian_matrix_global_.size(); i++)
+    jacobian_matrix_global_[i]=0.0;
+  for(int i=0; i<jacobian_upper_matrix_global_.size(); i++)
+    jacobian_upper_matrix_global_[i]=0.0;
   for(int i=0; i<heat_load_.size(); i++){
     heat_load_[i]=0.0;
     radiation_load_[i]=0.0;
@@ -1861,6 +2630,11 @@ public:
   void AssembleGlobalYfunction(std::vector<int>&, GlobalVectorsAndMatrices*);
   void PrintGlobalJacobian(GlobalVectorsAndMatrices*);
   void PrintGlobalYfunction(GlobalVectorsAndMatrices*);
+
+private:
+  std::vector<double> temperature_increments_of_equations_;
+  std::vector<double> temperatures_of_equations_;
+  std::vector<double> mass_and_stiffness_product_;
 };
 void Assemble::AssembleGlobalJacobian(GlobalVectorsAndMatrices* global_vectors_and_matrices){
   double new_value;
@@ -1875,30 +2649,31 @@ void Assemble::AssembleGlobalJacobian(GlobalVectorsAndMatrices* global_vectors_a
 
 void Assemble::AssembleGlobalYfunction(std::vector<int>& equation_numbers_of_nodes, GlobalVectorsAndMatrices* global_vectors_and_matrices){
   int num_of_nodes=equation_numbers_of_nodes.size();
-  int row_equation_number=-1;
-  int column_equation_number=-1;
-  double term_one=0.0;
-  double term_two=0.0;
+  int num_of_equations=((*global_vectors_and_matrices).get_right_hand_side_function()).size();
+  std::vector<double>& current_temperature_field=(*global_vectors_and_matrices).get_current_temperature_field();
+  std::vector<double>& initial_temperature_field=(*global_vectors_and_matrices).get_initial_temperature_field();
+  temperature_increments_of_equations_.resize(num_of_equations, 0.0);
+  temperatures_of_equations_.resize(num_of_equations, 0.0);
+  mass_and_stiffness_product_.resize(num_of_equations, 0.0);
+
+  //gather nodal temperatures into equation ordering; fixed nodes are already accounted for in heat_load by FixTemperature
   for(int i=0;i<num_of_nodes;i++){
-    term_one=0.0;
-    term_two=0.0;
-    for(int j=0;j<num_of_nodes;j++){
-      row_equation_number=equation_numbers_of_nodes[i];
-      column_equation_number=equation_numbers_of_nodes[j];
-      if(row_equation_number>=0 && column_equation_number>=0){
-        term_one += (*global_vectors_and_matrices).MassMatrixIndex(row_equation_number,column_equation_number)*
-                    ((*global_vectors_and_matrices).get_current_temperature_field()[j]
-                    -(*global_vectors_and_matrices).get_initial_temperature_field()[j]);
-        term_two += ((*global_vectors_and_matrices).StiffnessMatrixIndex(row_equation_number,column_equation_number))*
-                    ((*global_vectors_and_matrices).get_current_temperature_field()[j]);
-      }
+    int equation_number=equation_numbers_of_nodes[i];
+    if(equation_number>=0){
+      temperature_increments_of_equations_[equation_number]=current_temperature_field[i]-initial_temperature_field[i];
+      temperatures_of_equations_[equation_number]=current_temperature_field[i];
     }
+  }
 
-    if(row_equation_number>=0 && column_equation_number>=0){
-    (*global_vectors_and_matrices).get_right_hand_side_function()[row_equation_number]= 
-       ((*global_vectors_and_matrices).get_heat_load()[row_equation_number]) - 
-       ((*global_vectors_and_matrices).get_radiation_load()[row_equation_number])-term_one-term_two; 
-    }
+  // M*(T-T0)+K*T in a single pass over the stored profile
+  (*global_vectors_and_matrices).SymmetricBandedMatrixVectorProduct((*global_vectors_and_matrices).get_mass_matrix(), 
+    temperature_increments_of_equations_, (*global_vectors_and_matrices).get_stiffness_matrix(), temperatures_of_equations_, 
+    mass_and_stiffness_product_);
+
+  for(int i=0;i<num_of_equations;i++){
+    (*global_vectors_and_matrices).get_right_hand_side_function()[i]= 
+       ((*global_vectors_and_matrices).get_heat_load()[i]) - 
+       ((*global_vectors_and_matrices).get_radiation_load()[i])-mass_and_stiffness_product_[i]; 
   }
 //printf("Generating R.H.S global function completed\n");
 }
@@ -1917,11 +2692,1465 @@ void Assemble::PrintGlobalYfunction(GlobalVectorsAndMatrices* global_vectors_and
 }
 
 
+// Fixed set of worker threads that repeatedly run a batch of independent tasks. The calling thread takes part as thread 0,
+// tasks are handed out through an atomic counter and RunTasks returns once the whole batch is done.
+class ThreadPool{
+public:
+  ThreadPool():num_of_tasks_(0),num_of_busy_workers_(0),generation_(0),is_shutting_down_(false){}
+  ~ThreadPool();
+  void InitializeThreadPool(int);
+  int get_num_of_threads() const
+    {return workers_.size()+1;}
+  void RunTasks(int, const std::function<void(int,int)>&);
+
+private:
+  void WorkerLoop(int);
+  void ExecuteTasks(int);
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable work_available_;
+  std::condition_variable work_finished_;
+  std::function<void(int,int)> task_;
+  int num_of_tasks_;
+  std::atomic<int> next_task_;
+  int num_of_busy_workers_;
+  int generation_;
+  bool is_shutting_down_;
+};
+ThreadPool::~ThreadPool(){
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    is_shutting_down_=true;
+  }
+  work_available_.notify_all();
+  for(int i=0;i<(int)workers_.size();i++)
+    workers_[i].join();
+}
+
+void ThreadPool::InitializeThreadPool(int num_of_threads){
+  if(num_of_threads<=0) num_of_threads=std::thread::hardware_concurrency();
+  if(num_of_threads<=0) num_of_threads=1;
+  for(int i=1;i<num_of_threads;i++)
+    workers_.push_back(std::thread(&ThreadPool::WorkerLoop, this, i));
+}
+
+void ThreadPool::RunTasks(const int num_of_tasks, const std::function<void(int,int)>& task){
+  if(workers_.empty() || num_of_tasks<=1){
+    for(int i=0;i<num_of_tasks;i++) task(i,0);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    task_=task;
+    num_of_tasks_=num_of_tasks;
+    next_task_=0;
+    num_of_busy_workers_=workers_.size();
+    generation_++;
+  }
+  work_available_.notify_all();
+  ExecuteTasks(0);
+  std::unique_lock<std::mutex> lock(mutex_);
+  work_finished_.wait(lock, [this]{return num_of_busy_workers_==0;});
+}
+
+void ThreadPool::ExecuteTasks(const int thread_id){
+  for(int task_id=next_task_++; task_id<num_of_tasks_; task_id=next_task_++)
+    task_(task_id, thread_id);
+}
+
+void ThreadPool::WorkerLoop(const int thread_id){
+  int last_generation=0;
+  while(1){
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      work_available_.wait(lock, [&]{return is_shutting_down_ || generation_!=last_generation;});
+      if(is_shutting_down_) return;
+      last_generation=generation_;
+    }
+    ExecuteTasks(thread_id);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(--num_of_busy_workers_==0) work_finished_.notify_one();
+  }
+}
+
+
+// Element matrices are held as mutable members of the Elemental* objects, so every assembly thread owns one set of them.
+class AssemblyWorkspace{
+public:
+  void InitializeAssemblyWorkspace();
+  ElementalStiffnessMatrix elemental_stiffness_matrix_;
+  ElementalMassMatrix elemental_mass_matrix_;
+  ElementalBodyHeatFluxTangentialMatrix elemental_body_heat_flux_tangential_matrix_;
+  ElementalRadiationTangentialMatrixAndRadiationLoad elemental_radiation_tangential_matrix_and_radiation_load_;
+};
+void AssemblyWorkspace::InitializeAssemblyWorkspace(){
+  elemental_stiffness_matrix_.InitializeElementalStiffnessMatrix();
+  elemental_mass_matrix_.InitializeElementalMassMatrix();
+  elemental_body_heat_flux_tangential_matrix_.InitializeElementalBodyHeatFluxTangentialMatrix();
+  elemental_radiation_tangential_matrix_and_radiation_load_.InitializeElementalRadiationTangentialMatrixAndRadiationLoad();
+}
+
+
+// Element loops of one newton iteration. The structured quad mesh is 4-colored by the parity of the element column and row, so
+// elements of one color never share a node and therefore never scatter into the same global entry; each color is then
+// assembled concurrently on the thread pool.
+class ParallelAssembly{
+public:
+  void InitializeParallelAssembly(Initialization*const, GenerateMesh*const, DegreeOfFreedomAndEquationNumbers*const, ElementScatterMap*const, 
+  BoundaryCondition*const, HeaterElements*const, RadiationElements*const, MaterialParameters*const, TemperatureDependentVariables*const, 
+  ElementGeometryCache*const, ElementGeometryCache*const, ElementTensorIntegrals*const);
+  void AssembleElementContributions(GlobalVectorsAndMatrices*, double);
+  void AssembleFusedJacobianAndResidual(GlobalVectorsAndMatrices*, double);
+  void AssembleFusedResidual(GlobalVectorsAndMatrices*, double);
+  int get_num_of_threads() const
+    {return thread_pool_.get_num_of_threads();}
+
+private:
+  void ColorElements(std::vector<int>&, std::vector<std::vector<int> >&);
+  void RunColoredLoop(std::vector<std::vector<int> >&, const std::function<void(int,AssemblyWorkspace&)>&);
+  void AssembleConductionAndCapacityElement(int, AssemblyWorkspace&, GlobalVectorsAndMatrices*, double);
+  void AssembleHeaterElement(int, AssemblyWorkspace&, GlobalVectorsAndMatrices*);
+  void AssembleRadiationElement(int, AssemblyWorkspace&, GlobalVectorsAndMatrices*);
+  void AssembleFusedElement(int, AssemblyWorkspace&, GlobalVectorsAndMatrices*, double, bool, const QuadElementMatrix* =NULL, 
+  const QuadElementMatrix* =NULL);
+  void AssembleFusedBatch(int, AssemblyWorkspace&, GlobalVectorsAndMatrices*, double, bool);
+
+  Initialization* initialization_;
+  GenerateMesh* generate_mesh_;
+  DegreeOfFreedomAndEquationNumbers* dof_and_equation_numbers_;
+  ElementScatterMap* element_scatter_map_;
+  BoundaryCondition* boundary_condition_;
+  HeaterElements* heater_elements_;
+  RadiationElements* radiation_elements_;
+  MaterialParameters* material_parameters_;
+  TemperatureDependentVariables* temperature_dependent_variables_;
+  ElementGeometryCache* geometry_cache_three_by_three_;
+  ElementGeometryCache* geometry_cache_two_by_two_;
+  ElementTensorIntegrals* element_tensor_integrals_;
+  BatchedElementKernels batched_element_kernels_;
+  ThreadPool thread_pool_;
+  std::vector<AssemblyWorkspace> workspaces_;
+  std::vector<std::vector<int> > colored_elements_;            //element numbers
+  std::vector<std::vector<int> > colored_heater_elements_;     //positions in elements_as_heater
+  std::vector<std::vector<int> > colored_radiation_elements_;  //positions in elements_with_radiation
+  std::vector<std::vector<int> > colored_batches_;             //batch numbers in batched_element_kernels_
+  std::vector<int> heater_element_number_of_elements_;         //-1 for elements that are not heaters
+  std::vector<int> radiation_element_number_of_elements_;      //-1 for elements off the radiating surface
+};
+void ParallelAssembly::InitializeParallelAssembly(Initialization *const initialization, GenerateMesh *const generate_mesh, 
+DegreeOfFreedomAndEquationNumbers *const dof_and_equation_numbers, ElementScatterMap *const element_scatter_map, BoundaryCondition *const boundary_condition, 
+HeaterElements *const heater_elements, RadiationElements *const radiation_elements, MaterialParameters *const material_parameters, 
+TemperatureDependentVariables *const temperature_dependent_variables, ElementGeometryCache *const geometry_cache_three_by_three, 
+ElementGeometryCache *const geometry_cache_two_by_two, ElementTensorIntegrals *const element_tensor_integrals){
+  initialization_=initialization;
+  generate_mesh_=generate_mesh;
+  dof_and_equation_numbers_=dof_and_equation_numbers;
+  element_scatter_map_=element_scatter_map;
+  boundary_condition_=boundary_condition;
+  heater_elements_=heater_elements;
+  radiation_elements_=radiation_elements;
+  material_parameters_=material_parameters;
+  temperature_dependent_variables_=temperature_dependent_variables;
+  geometry_cache_three_by_three_=geometry_cache_three_by_three;
+  geometry_cache_two_by_two_=geometry_cache_two_by_two;
+  element_tensor_integrals_=element_tensor_integrals;
+
+  thread_pool_.InitializeThreadPool(Constants::kNumOfAssemblyThreads_);
+  workspaces_.resize(thread_pool_.get_num_of_threads());
+  for(int i=0;i<(int)workspaces_.size();i++)
+    workspaces_[i].InitializeAssemblyWorkspace();
+
+  std::vector<int> all_elements((*((*initialization).get_mesh_parameters())).get_num_of_elements());
+  for(int i=0;i<(int)all_elements.size();i++) all_elements[i]=i;
+  ColorElements(all_elements, colored_elements_);
+  ColorElements((*heater_elements).get_elements_as_heater(), colored_heater_elements_);
+  ColorElements((*radiation_elements).get_elements_with_radiation(), colored_radiation_elements_);
+
+  //cut every color into runs of one material for the batched kernels
+  if(Constants::kUseBatchedSimdKernels_){
+    std::vector<int>& material_id_of_elements=(*material_parameters).get_material_id_of_elements();
+    batched_element_kernels_.InitializeBatchedElementKernels(geometry_cache_three_by_three);
+    colored_batches_.clear();
+    colored_batches_.resize(colored_elements_.size());
+    for(int color=0;color<(int)colored_elements_.size();color++){
+      std::vector<int> elements_in_batch;
+      for(int i=0;i<(int)colored_elements_[color].size();i++){
+        int element_number=colored_elements_[color][i];
+        if(!elements_in_batch.empty() && (elements_in_batch.size()==BatchedElementKernels::kBatchWidth_ 
+           || material_id_of_elements[element_number]!=material_id_of_elements[elements_in_batch[0]])){
+          colored_batches_[color].push_back(batched_element_kernels_.AddBatch(elements_in_batch));
+          elements_in_batch.clear();
+        }
+        elements_in_batch.push_back(element_number);
+      }
+      if(!elements_in_batch.empty()) colored_batches_[color].push_back(batched_element_kernels_.AddBatch(elements_in_batch));
+    }
+  }
+
+  heater_element_number_of_elements_.assign(all_elements.size(), -1);
+  for(int i=0;i<(int)(*heater_elements).get_elements_as_heater().size();i++)
+    heater_element_number_of_elements_[(*heater_elements).get_elements_as_heater()[i]]=i;
+  radiation_element_number_of_elements_.assign(all_elements.size(), -1);
+  for(int i=0;i<(int)(*radiation_elements).get_elements_with_radiation().size();i++)
+    radiation_element_number_of_elements_[(*radiation_elements).get_elements_with_radiation()[i]]=i;
+}
+
+// stores positions in element_list, bucketed by the parity color of the listed element
+void ParallelAssembly::ColorElements(std::vector<int>& element_list, std::vector<std::vector<int> >& colored_positions){
+  int num_of_elements_along_x=(*((*initialization_).get_mesh_parameters())).get_dimensions_of_x()-1;
+  colored_positions.clear();
+  colored_positions.resize(4);
+  for(int i=0;i<(int)element_list.size();i++){
+    int column_of_element=element_list[i]%num_of_elements_along_x;
+    int row_of_element=element_list[i]/num_of_elements_along_x;
+    colored_positions[(column_of_element%2)+2*(row_of_element%2)].push_back(i);
+  }
+}
+
+void ParallelAssembly::RunColoredLoop(std::vector<std::vector<int> >& colored_positions, const std::function<void(int,AssemblyWorkspace&)>& element_task){
+  for(int color=0;color<(int)colored_positions.size();color++){
+    std::vector<int>& positions=colored_positions[color];
+    int num_of_positions=positions.size();
+    if(num_of_positions==0) continue;
+    int num_of_tasks=4*thread_pool_.get_num_of_threads();
+    if(num_of_tasks>num_of_positions) num_of_tasks=num_of_positions;
+    thread_pool_.RunTasks(num_of_tasks, [&](const int task_id, const int thread_id){
+      int first_position=(long long)num_of_positions*task_id/num_of_tasks;
+      int last_position=(long long)num_of_positions*(task_id+1)/num_of_tasks;
+      for(int i=first_position;i<last_position;i++)
+        element_task(positions[i], workspaces_[thread_id]);
+    });
+  }
+}
+
+void ParallelAssembly::AssembleElementContributions(GlobalVectorsAndMatrices* global_vectors_and_matrices, const double time_increment){
+  RunColoredLoop(colored_elements_, [&](const int element_number, AssemblyWorkspace& workspace){
+    AssembleConductionAndCapacityElement(element_number, workspace, global_vectors_and_matrices, time_increment);
+  });
+  RunColoredLoop(colored_heater_elements_, [&](const int heater_element_number, AssemblyWorkspace& workspace){
+    AssembleHeaterElement(heater_element_number, workspace, global_vectors_and_matrices);
+  });
+  RunColoredLoop(colored_radiation_elements_, [&](const int radiation_element_number, AssemblyWorkspace& workspace){
+    AssembleRadiationElement(radiation_element_number, workspace, global_vectors_and_matrices);
+  });
+}
+
+void ParallelAssembly::AssembleConductionAndCapacityElement(const int element_number, AssemblyWorkspace& workspace, 
+GlobalVectorsAndMatrices* global_vectors_and_matrices, const double time_increment){
+  std::vector<int>& nodes_in_elements=(*dof_and_equation_numbers_).get_nodes_in_elements();
+  std::vector<int>& equation_numbers_in_elements=(*dof_and_equation_numbers_).get_equation_numbers_in_elements();
+  const int* storage_offsets=(*element_scatter_map_).get_storage_offsets(element_number);
+  std::vector<int>& material_id_of_elements=(*material_parameters_).get_material_id_of_elements();
+  std::vector<double>& densities=(*material_parameters_).get_densities();
+  std::vector<double>& current_temperature_field=(*global_vectors_and_matrices).get_current_temperature_field();
+
+  if(Constants::kUseTensorIntegralAssembly_){
+    int material_id=material_id_of_elements[element_number];
+    QuadElementVector nodal_temperatures;
+    for(int ii=0;ii<Constants::kNumOfNodesInElement_;ii++)
+      nodal_temperatures[ii]=current_temperature_field[nodes_in_elements[ii+element_number*Constants::kNumOfNodesInElement_]];
+    QuadElementMatrix contracted_stiffness_matrix, contracted_mass_matrix;
+    (*element_tensor_integrals_).ContractElementMatrices(element_number, nodal_temperatures, 
+      (*temperature_dependent_variables_).get_thermal_conductivity_coefficients(material_id), 
+      (*temperature_dependent_variables_).get_specific_heat_coefficients(material_id), densities[material_id]/time_increment, 
+      contracted_stiffness_matrix, contracted_mass_matrix);
+    workspace.elemental_stiffness_matrix_.set_element_stiffness_matrix(contracted_stiffness_matrix);
+    workspace.elemental_mass_matrix_.set_element_mass_matrix(contracted_mass_matrix);
+  }
+  else{
+    workspace.elemental_stiffness_matrix_.set_element_stiffness_matrix(element_number, nodes_in_elements, material_id_of_elements, 
+      current_temperature_field, temperature_dependent_variables_, geometry_cache_three_by_three_);
+    workspace.elemental_mass_matrix_.set_element_mass_matrix(element_number, nodes_in_elements, material_id_of_elements, 
+      current_temperature_field, temperature_dependent_variables_, densities, time_increment, geometry_cache_three_by_three_);
+  }
+  workspace.elemental_stiffness_matrix_.MapElementalToGlobalStiffness((*global_vectors_and_matrices).get_stiffness_matrix(), storage_offsets);
+  workspace.elemental_mass_matrix_.MapElementalToGlobalMass((*global_vectors_and_matrices).get_mass_matrix(), storage_offsets);
+
+  (*boundary_condition_).FixTemperature(element_number, workspace.elemental_stiffness_matrix_.get_element_stiffness_matrix(), 
+    storage_offsets, equation_numbers_in_elements, (*global_vectors_and_matrices).get_heat_load());
+}
+
+void ParallelAssembly::AssembleHeaterElement(const int heater_element_number, AssemblyWorkspace& workspace, 
+GlobalVectorsAndMatrices* global_vectors_and_matrices){
+  std::vector<int>& nodes_in_elements=(*dof_and_equation_numbers_).get_nodes_in_elements();
+  std::vector<int>& equation_numbers_in_elements=(*dof_and_equation_numbers_).get_equation_numbers_in_elements();
+  std::vector<double>& current_temperature_field=(*global_vectors_and_matrices).get_current_temperature_field();
+  int element_number=(*heater_elements_).get_elements_as_heater()[heater_element_number];
+
+  workspace.elemental_body_heat_flux_tangential_matrix_.set_element_body_heat_flux_tangential_matrix(element_number, heater_element_number, 
+    nodes_in_elements, current_temperature_field, temperature_dependent_variables_, initialization_, geometry_cache_two_by_two_);
+  workspace.elemental_body_heat_flux_tangential_matrix_.MapElementalToGlobalBodyHeatFluxTangentialMatrix(
+    (*global_vectors_and_matrices).get_body_heat_flux_tangential(), (*element_scatter_map_).get_storage_offsets(element_number));
+
+  //HeatSupply only reads the geometry cache, so the shared heater object is safe to call from any thread
+  (*heater_elements_).HeatSupply(element_number, heater_element_number, (*global_vectors_and_matrices).get_heat_load(), nodes_in_elements, 
+    equation_numbers_in_elements, current_temperature_field, temperature_dependent_variables_, initialization_, geometry_cache_two_by_two_);
+}
+
+void ParallelAssembly::AssembleRadiationElement(const int radiation_element_number, AssemblyWorkspace& workspace, 
+GlobalVectorsAndMatrices* global_vectors_and_matrices){
+  std::vector<int>& nodes_in_elements=(*dof_and_equation_numbers_).get_nodes_in_elements();
+  std::vector<int>& equation_numbers_in_elements=(*dof_and_equation_numbers_).get_equation_numbers_in_elements();
+  int element_number=(*radiation_elements_).get_elements_with_radiation()[radiation_element_number];
+  double ambient_temperature=(*((*initialization_).get_analysis_constants())).get_ambient_temperature();
+
+  workspace.elemental_radiation_tangential_matrix_and_radiation_load_.set_element_radiation_tangential_matrix_and_radiation_load(element_number, 
+    radiation_element_number, nodes_in_elements, (*global_vectors_and_matrices).get_current_temperature_field(), temperature_dependent_variables_, 
+    (*generate_mesh_).get_x_coordinates(), ambient_temperature);
+  workspace.elemental_radiation_tangential_matrix_and_radiation_load_.MapElementalToGlobalRadiationTangentialMatrixAndRadiationLoad(
+    (*global_vectors_and_matrices).get_radiation_tangential_matrix(), (*element_scatter_map_).get_storage_offsets(element_number), 
+    (*global_vectors_and_matrices).get_radiation_load(), equation_numbers_in_elements, element_number);
+}
+
+
+// Fused path: every element is visited once and its conduction, capacity, joule heating and radiation terms go straight into
+// jacobian_matrix_global and right_hand_side_function. The element residual f-M*(T-T0)-K*T-r runs over all four nodes, so the
+// fixed temperature correction of FixTemperature is included without a separate pass.
+void ParallelAssembly::AssembleFusedJacobianAndResidual(GlobalVectorsAndMatrices* global_vectors_and_matrices, const double time_increment){
+  if(Constants::kUseBatchedSimdKernels_){
+    RunColoredLoop(colored_batches_, [&](const int batch_number, AssemblyWorkspace& workspace){
+      AssembleFusedBatch(batch_number, workspace, global_vectors_and_matrices, time_increment, false);
+    });
+    return;
+  }
+  RunColoredLoop(colored_elements_, [&](const int element_number, AssemblyWorkspace& workspace){
+    AssembleFusedElement(element_number, workspace, global_vectors_and_matrices, time_increment, false);
+  });
+}
+
+// the residual alone, overwriting right_hand_side_function; the jacobian storage is left untouched
+void ParallelAssembly::AssembleFusedResidual(GlobalVectorsAndMatrices* global_vectors_and_matrices, const double time_increment){
+  std::vector<double>& right_hand_side_function=(*global_vectors_and_matrices).get_right_hand_side_function();
+  std::fill(right_hand_side_function.begin(), right_hand_side_function.end(), 0.0);
+  if(Constants::kUseBatchedSimdKernels_){
+    RunColoredLoop(colored_batches_, [&](const int batch_number, AssemblyWorkspace& workspace){
+      AssembleFusedBatch(batch_number, workspace, global_vectors_and_matrices, time_increment, true);
+    });
+    return;
+  }
+  RunColoredLoop(colored_elements_, [&](const int element_number, AssemblyWorkspace& workspace){
+    AssembleFusedElement(element_number, workspace, global_vectors_and_matrices, time_increment, true);
+  });
+}
+
+void ParallelAssembly::AssembleFusedBatch(const int batch_number, AssemblyWorkspace& workspace, 
+GlobalVectorsAndMatrices* global_vectors_and_matrices, const double time_increment, const bool is_residual_only){
+  const int kBatchWidth=BatchedElementKernels::kBatchWidth_;
+  std::vector<int>& nodes_in_elements=(*dof_and_equation_numbers_).get_nodes_in_elements();
+  std::vector<double>& current_temperature_field=(*global_vectors_and_matrices).get_current_temperature_field();
+  const int* element_numbers=batched_element_kernels_.get_element_numbers(batch_number);
+  int material_id=(*material_parameters_).get_material_id_of_elements()[element_numbers[0]];
+
+  double nodal_temperatures[4*kBatchWidth];
+  for(int lane=0;lane<kBatchWidth;lane++)
+    for(int a=0;a<4;a++)
+      nodal_temperatures[a*kBatchWidth+lane]=current_temperature_field[nodes_in_elements[a+element_numbers[lane]*Constants::kNumOfNodesInElement_]];
+
+  double element_stiffness_matrices[16*kBatchWidth], element_mass_matrices[16*kBatchWidth];
+  batched_element_kernels_.ComputeConductionAndCapacity(batch_number, nodal_temperatures, 
+    (*temperature_dependent_variables_).get_thermal_conductivity_coefficients(material_id), 
+    (*temperature_dependent_variables_).get_specific_heat_coefficients(material_id), 
+    (*material_parameters_).get_densities()[material_id]/time_increment, element_stiffness_matrices, element_mass_matrices);
+
+  for(int lane=0;lane<batched_element_kernels_.get_num_of_lanes(batch_number);lane++){
+    QuadElementMatrix element_stiffness_matrix, element_mass_matrix;
+    for(int ij=0;ij<16;ij++){
+      element_stiffness_matrix[ij/4][ij%4]=element_stiffness_matrices[ij*kBatchWidth+lane];
+      element_mass_matrix[ij/4][ij%4]=element_mass_matrices[ij*kBatchWidth+lane];
+    }
+    AssembleFusedElement(element_numbers[lane], workspace, global_vectors_and_matrices, time_increment, is_residual_only, 
+      &element_stiffness_matrix, &element_mass_matrix);
+  }
+}
+
+// batched_stiffness_matrix and batched_mass_matrix, when given, come from the batched kernels and replace the element's own K and M
+void ParallelAssembly::AssembleFusedElement(const int element_number, AssemblyWorkspace& workspace, 
+GlobalVectorsAndMatrices* global_vectors_and_matrices, const double time_increment, const bool is_residual_only, 
+const QuadElementMatrix* batched_stiffness_matrix, const QuadElementMatrix* batched_mass_matrix){
+  std::vector<int>& nodes_in_elements=(*dof_and_equation_numbers_).get_nodes_in_elements();
+  std::vector<int>& equation_numbers_in_elements=(*dof_and_equation_numbers_).get_equation_numbers_in_elements();
+  const int* storage_offsets=(*element_scatter_map_).get_storage_offsets(element_number);
+  std::vector<int>& material_id_of_elements=(*material_parameters_).get_material_id_of_elements();
+  std::vector<double>& current_temperature_field=(*global_vectors_and_matrices).get_current_temperature_field();
+  std::vector<double>& initial_temperature_field=(*global_vectors_and_matrices).get_initial_temperature_field();
+  int material_id=material_id_of_elements[element_number];
+  double density_over_time_increment=(*material_parameters_).get_densities()[material_id]/time_increment;
+  const double* conductivity_coefficients=(*temperature_dependent_variables_).get_thermal_conductivity_coefficients(material_id);
+  const double* specific_heat_coefficients=(*temperature_dependent_variables_).get_specific_heat_coefficients(material_id);
+  int heater_element_number=heater_element_number_of_elements_[element_number];
+  int radiation_element_number=radiation_element_number_of_elements_[element_number];
+
+  QuadElementVector nodal_temperatures, nodal_temperature_increments;
+  for(int ii=0;ii<Constants::kNumOfNodesInElement_;ii++){
+    int node=nodes_in_elements[ii+element_number*Constants::kNumOfNodesInElement_];
+    nodal_temperatures[ii]=current_temperature_field[node];
+    nodal_temperature_increments[ii]=current_temperature_field[node]-initial_temperature_field[node];
+  }
+
+  QuadElementMatrix element_stiffness_matrix, element_mass_matrix, element_jacobian={};
+  QuadElementVector element_load={};
+  if(batched_stiffness_matrix!=NULL){
+    element_stiffness_matrix=*batched_stiffness_matrix;
+    element_mass_matrix=*batched_mass_matrix;
+  }
+  else if(Constants::kUseTensorIntegralAssembly_){
+    (*element_tensor_integrals_).ContractElementMatrices(element_number, nodal_temperatures, conductivity_coefficients, 
+      specific_heat_coefficients, density_over_time_increment, element_stiffness_matrix, element_mass_matrix);
+  }
+  else{
+    IntegrateConduction<Constants::kNumOfNodesInElement_, GaussLegendreRule<3>::kNumOfTensorProductPoints_>(*geometry_cache_three_by_three_, 
+      element_number, nodal_temperatures, (*temperature_dependent_variables_).get_thermal_conductivity_table(material_id), 
+      element_stiffness_matrix);
+    IntegrateCapacity<Constants::kNumOfNodesInElement_, GaussLegendreRule<3>::kNumOfTensorProductPoints_>(*geometry_cache_three_by_three_, 
+      element_number, nodal_temperatures, (*temperature_dependent_variables_).get_specific_heat_table(material_id), 
+      density_over_time_increment, element_mass_matrix);
+  }
+
+  //joule heating uses the 3x3 points of conduction and capacity
+  if(heater_element_number>=0){
+    int heater_number=heater_element_number/(*((*initialization_).get_mesh_parameters())).get_mesh_seeds_on_heater();
+    double current=(*((*initialization_).get_currents_in_heater())).get_current_in_heater()[heater_number];
+    for(int q=0;q<GaussLegendreRule<3>::kNumOfTensorProductPoints_;q++){
+      const double* shape_function=(*geometry_cache_three_by_three_).get_shape_function(element_number, q);
+      double determinant_times_weight=(*geometry_cache_three_by_three_).get_determinant_times_weight(element_number, q);
+      double temperature=0.0;
+      for(int ii=0;ii<Constants::kNumOfNodesInElement_;ii++)
+        temperature += nodal_temperatures[ii]*shape_function[ii];
+      double body_heat_flux, flux_derivative;
+      (*temperature_dependent_variables_).get_body_heat_flux_and_derivative(temperature, current, body_heat_flux, flux_derivative);
+      body_heat_flux *= determinant_times_weight;
+      flux_derivative *= determinant_times_weight;
+      for(int i=0;i<Constants::kNumOfNodesInElement_;i++){
+        element_load[i] += shape_function[i]*body_heat_flux;
+        for(int j=0;j<Constants::kNumOfNodesInElement_;j++)
+          element_jacobian[i][j] += flux_derivative*shape_function[i]*shape_function[j];
+      }
+    }
+  }
+
+  //consistent tangent: dK/dT*T and dM/dT*(T-T0), and joule heating enters with the sign of its residual term
+  if(Constants::kUseConsistentTangent_ && !is_residual_only){
+    QuadElementMatrix element_tangent;
+    IntegrateConductionAndCapacityTangent<Constants::kNumOfNodesInElement_, GaussLegendreRule<3>::kNumOfTensorProductPoints_>(
+      *geometry_cache_three_by_three_, element_number, nodal_temperatures, nodal_temperature_increments, 
+      (*temperature_dependent_variables_).get_thermal_conductivity_table(material_id), 
+      (*temperature_dependent_variables_).get_specific_heat_table(material_id), density_over_time_increment, element_tangent);
+    for(int i=0;i<Constants::kNumOfNodesInElement_;i++)
+      for(int j=0;j<Constants::kNumOfNodesInElement_;j++)
+        element_jacobian[i][j]=element_tangent[i][j]-element_jacobian[i][j];
+  }
+
+  //radiation acts on the top edge (3rd and 4th node) with its own edge rule
+  if(radiation_element_number>=0){
+    ElementalRadiationTangentialMatrixAndRadiationLoad& radiation=workspace.elemental_radiation_tangential_matrix_and_radiation_load_;
+    radiation.set_element_radiation_tangential_matrix_and_radiation_load(element_number, radiation_element_number, nodes_in_elements, 
+      current_temperature_field, temperature_dependent_variables_, (*generate_mesh_).get_x_coordinates(), 
+      (*((*initialization_).get_analysis_constants())).get_ambient_temperature());
+    for(int i=2;i<Constants::kNumOfNodesInElement_;i++){
+      element_load[i] -= radiation.get_local_radiation_load()[i-2];
+      for(int j=2;j<Constants::kNumOfNodesInElement_;j++)
+        element_jacobian[i][j] += radiation.get_element_radiation_tangential_matrix()[i][j];
+    }
+  }
+
+  std::vector<double>& jacobian_matrix_global=(*global_vectors_and_matrices).get_jacobian_matrix_global();
+  std::vector<double>& jacobian_upper_matrix_global=(*global_vectors_and_matrices).get_jacobian_upper_matrix_global();
+  std::vector<double>& right_hand_side_function=(*global_vectors_and_matrices).get_right_hand_side_function();
+  for(int i=0;i<Constants::kNumOfNodesInElement_;i++){
+    int row_equation_number=equation_numbers_in_elements[i+element_number*Constants::kNumOfNodesInElement_];
+    if(row_equation_number<0) continue;
+    double residual=element_load[i];
+    for(int j=0;j<Constants::kNumOfNodesInElement_;j++)
+      residual -= element_mass_matrix[i][j]*nodal_temperature_increments[j]+element_stiffness_matrix[i][j]*nodal_temperatures[j];
+    right_hand_side_function[row_equation_number] += residual;
+    if(is_residual_only) continue;
+    for(int j=0;j<Constants::kNumOfNodesInElement_;j++){
+      int position_in_desparsed_matrix=storage_offsets[i*Constants::kNumOfNodesInElement_+j];
+      if(position_in_desparsed_matrix<0) continue;
+      jacobian_matrix_global[position_in_desparsed_matrix] += element_stiffness_matrix[i][j]+element_mass_matrix[i][j]+element_jacobian[i][j];
+      if(Constants::kUseConsistentTangent_) //(j,i) lands in the upper triangle at the mirrored position
+        jacobian_upper_matrix_global[position_in_desparsed_matrix] += element_stiffness_matrix[j][i]+element_mass_matrix[j][i]
+                                                                      +element_jacobian[j][i];
+    }
+  }
+}
+
+// geometric multigrid on the tensor product grid. columns of nodes are coarsened along x (every other column, linear 
+// interpolation in the x coordinate, identity through the thickness), coarse operators are galerkin products, and each 
+// column is relaxed as one tridiagonal line across the layers. serves as the conjugate gradient preconditioner; the v-cycle
+// sweeps the lines forward before and backward after the coarse correction, so it stays symmetric.
+class GeometricMultigrid{
+public:
+  static const int kNumOfStencilEntries_=9;
+  static const int kMaxColumnsOnCoarsestLevel_=3;
+  void InitializeGeometricMultigrid(Initialization *const, GenerateMesh *const, DegreeOfFreedomAndEquationNumbers *const);
+  int BuildLevelOperators(std::vector<double>&, std::vector<int>&);
+  int BuildLevelOperatorsFromStencils(std::vector<double>&);
+  void ApplyVCycle(std::vector<double>&, std::vector<double>&);
+  int get_num_of_levels() const
+    {return num_of_columns_.size();}
+  void PrintGeometricMultigridLevels(){
+    for(int level=0; level<(int)num_of_columns_.size(); level++)
+      printf("multigrid level %d has %d x %d grid points\n", level, num_of_columns_[level], num_of_rows_);
+  }
+
+private:
+  //stencil of grid point (column,row) on a level; shifts are -1, 0 or 1
+  double& StencilEntry(const int level, const int column, const int row, const int column_shift, const int row_shift)
+    {return stencils_[level][(column*num_of_rows_+row)*kNumOfStencilEntries_+(column_shift+1)*3+(row_shift+1)];}
+  //sum over the three couplings of a point to the rows row-1..row+1 of one column
+  double ColumnCouplingProduct(const double* stencil_entries, const double* column_values, const int row) const{
+    double product=stencil_entries[1]*column_values[row];
+    if(row>0) product += stencil_entries[0]*column_values[row-1];
+    if(row<num_of_rows_-1) product += stencil_entries[2]*column_values[row+1];
+    return product;
+  }
+  void VCycle(int);
+  void LineGaussSeidelSweep(int, bool);
+  int BuildCoarseLevelsAndFactors();
+  void FactorLines(int);
+  int FactorCoarsestLevel();
+  void SolveCoarsestLevel();
+
+  int num_of_rows_;
+  std::vector<int> num_of_columns_;
+  std::vector<int> equation_numbers_of_grid_points_; //finest level, grid point column*num_of_rows_+row, -1 if fixed
+  std::vector<std::vector<int> > left_coarse_columns_; //per fine column, the coarse column on its left (or itself)
+  std::vector<std::vector<double> > left_weights_;
+  std::vector<std::vector<double> > right_weights_;
+  std::vector<std::vector<double> > stencils_;
+  std::vector<std::vector<double> > line_pivots_; //LDL^T of every column's tridiagonal block
+  std::vector<std::vector<double> > line_multipliers_;
+  std::vector<std::vector<double> > right_hand_sides_;
+  std::vector<std::vector<double> > solutions_;
+  std::vector<std::vector<double> > residuals_;
+  std::vector<double> coarsest_band_factor_;
+  int coarsest_half_band_width_;
+};
+const int GeometricMultigrid::kNumOfStencilEntries_;
+const int GeometricMultigrid::kMaxColumnsOnCoarsestLevel_;
+void GeometricMultigrid::InitializeGeometricMultigrid(Initialization *const initialization, GenerateMesh *const generate_mesh, 
+DegreeOfFreedomAndEquationNumbers *const dof_and_equation_numbers){
+  int dimensions_of_x=(*((*initialization).get_mesh_parameters())).get_dimensions_of_x();
+  num_of_rows_=(*((*initialization).get_mesh_parameters())).get_dimensions_of_y();
+  std::vector<double>& x_coordinates=(*generate_mesh).get_x_coordinates();
+  std::vector<int>& equation_numbers_of_nodes=(*dof_and_equation_numbers).get_equation_numbers_of_nodes();
+
+  equation_numbers_of_grid_points_.resize(dimensions_of_x*num_of_rows_);
+  for(int i=0; i<dimensions_of_x; i++)
+    for(int j=0; j<num_of_rows_; j++)
+      equation_numbers_of_grid_points_[i*num_of_rows_+j]=equation_numbers_of_nodes[j*dimensions_of_x+i];
+
+  //coarse columns are the even fine columns plus the last one, weights from the x coordinates of the bracketing columns
+  num_of_columns_.assign(1, dimensions_of_x);
+  std::vector<double> column_x_coordinates(x_coordinates.begin(), x_coordinates.begin()+dimensions_of_x);
+  left_coarse_columns_.clear();
+  left_weights_.clear();
+  right_weights_.clear();
+  while(num_of_columns_.back()>kMaxColumnsOnCoarsestLevel_){
+    int num_of_fine_columns=num_of_columns_.back();
+    std::vector<int> fine_columns_kept;
+    for(int i=0; i<num_of_fine_columns; i+=2) fine_columns_kept.push_back(i);
+    if(fine_columns_kept.back()!=num_of_fine_columns-1) fine_columns_kept.push_back(num_of_fine_columns-1);
+
+    std::vector<int> left_coarse_columns(num_of_fine_columns);
+    std::vector<double> left_weights(num_of_fine_columns), right_weights(num_of_fine_columns);
+    int coarse_column=0;
+    for(int i=0; i<num_of_fine_columns; i++){
+      while(coarse_column+1<(int)fine_columns_kept.size() && fine_columns_kept[coarse_column+1]<=i) coarse_column++;
+      left_coarse_columns[i]=coarse_column;
+      if(fine_columns_kept[coarse_column]==i){
+        left_weights[i]=1.0;
+        right_weights[i]=0.0;
+      }
+      else{
+        double x_left=column_x_coordinates[fine_columns_kept[coarse_column]];
+        double x_right=column_x_coordinates[fine_columns_kept[coarse_column+1]];
+        right_weights[i]=(column_x_coordinates[i]-x_left)/(x_right-x_left);
+        left_weights[i]=1.0-right_weights[i];
+      }
+    }
+    left_coarse_columns_.push_back(left_coarse_columns);
+    left_weights_.push_back(left_weights);
+    right_weights_.push_back(right_weights);
+
+    std::vector<double> coarse_x_coordinates(fine_columns_kept.size());
+    for(int c=0; c<(int)fine_columns_kept.size(); c++) coarse_x_coordinates[c]=column_x_coordinates[fine_columns_kept[c]];
+    column_x_coordinates.swap(coarse_x_coordinates);
+    num_of_columns_.push_back(fine_columns_kept.size());
+  }
+
+  int num_of_levels=num_of_columns_.size();
+  stencils_.resize(num_of_levels);
+  line_pivots_.resize(num_of_levels);
+  line_multipliers_.resize(num_of_levels);
+  right_hand_sides_.resize(num_of_levels);
+  solutions_.resize(num_of_levels);
+  residuals_.resize(num_of_levels);
+  for(int level=0; level<num_of_levels; level++){
+    int num_of_grid_points=num_of_columns_[level]*num_of_rows_;
+    stencils_[level].assign(num_of_grid_points*kNumOfStencilEntries_, 0.0);
+    line_pivots_[level].assign(num_of_grid_points, 0.0);
+    line_multipliers_[level].assign(num_of_grid_points, 0.0);
+    right_hand_sides_[level].assign(num_of_grid_points, 0.0);
+    solutions_[level].assign(num_of_grid_points, 0.0);
+    residuals_[level].assign(num_of_grid_points, 0.0);
+  }
+  //grid points of the coarsest level numbered column by column, so a point couples at most num_of_rows_+1 back
+  coarsest_half_band_width_=num_of_rows_+1;
+  coarsest_band_factor_.assign(num_of_columns_.back()*num_of_rows_*(coarsest_half_band_width_+1), 0.0);
+}
+
+// reads the finest stencils from the skyline lower triangle, forms the galerkin coarse stencils and factors the line blocks 
+// and the coarsest level. fixed grid points keep a unit diagonal and no couplings. returns 1 if a factorization breaks down.
+int GeometricMultigrid::BuildLevelOperators(std::vector<double>& desparsed_matrix, std::vector<int>& accumulative_half_band_width_vector){
+  std::fill(stencils_[0].begin(), stencils_[0].end(), 0.0);
+  for(int i=0; i<num_of_columns_[0]; i++){
+    for(int j=0; j<num_of_rows_; j++){
+      int equation_number=equation_numbers_of_grid_points_[i*num_of_rows_+j];
+      if(equation_number<0){
+        StencilEntry(0, i, j, 0, 0)=1.0;
+        continue;
+      }
+      for(int column_shift=-1; column_shift<=1; column_shift++){
+        for(int row_shift=-1; row_shift<=1; row_shift++){
+          int neighbour_column=i+column_shift, neighbour_row=j+row_shift;
+          if(neighbour_column<0 || neighbour_column>=num_of_columns_[0] || neighbour_row<0 || neighbour_row>=num_of_rows_) continue;
+          int neighbour_equation_number=equation_numbers_of_grid_points_[neighbour_column*num_of_rows_+neighbour_row];
+          if(neighbour_equation_number<0) continue;
+          int row=(equation_number>neighbour_equation_number)?equation_number:neighbour_equation_number;
+          int column=equation_number+neighbour_equation_number-row;
+          StencilEntry(0, i, j, column_shift, row_shift)=desparsed_matrix[accumulative_half_band_width_vector[row]-(row-column)];
+        }
+      }
+    }
+  }
+  return BuildCoarseLevelsAndFactors();
+}
+
+// same as BuildLevelOperators for a finest operator already assembled in stencil form (ElementScatterMap::InitializeStencilScatterMap)
+int GeometricMultigrid::BuildLevelOperatorsFromStencils(std::vector<double>& finest_stencils){
+  stencils_[0]=finest_stencils;
+  for(int p=0; p<(int)equation_numbers_of_grid_points_.size(); p++){
+    if(equation_numbers_of_grid_points_[p]>=0) continue;
+    std::fill(&stencils_[0][p*kNumOfStencilEntries_], &stencils_[0][p*kNumOfStencilEntries_]+kNumOfStencilEntries_, 0.0);
+    stencils_[0][p*kNumOfStencilEntries_+4]=1.0;
+  }
+  return BuildCoarseLevelsAndFactors();
+}
+
+int GeometricMultigrid::BuildCoarseLevelsAndFactors(){
+  int num_of_levels=num_of_columns_.size();
+  for(int level=0; level+1<num_of_levels; level++){
+    std::vector<int>& left_coarse_columns=left_coarse_columns_[level];
+    std::vector<double>& left_weights=left_weights_[level];
+    std::vector<double>& right_weights=right_weights_[level];
+    std::fill(stencils_[level+1].begin(), stencils_[level+1].end(), 0.0);
+    for(int i=0; i<num_of_columns_[level]; i++){
+      for(int j=0; j<num_of_rows_; j++){
+        for(int column_shift=-1; column_shift<=1; column_shift++){
+          int neighbour_column=i+column_shift;
+          if(neighbour_column<0 || neighbour_column>=num_of_columns_[level]) continue;
+          for(int row_shift=-1; row_shift<=1; row_shift++){
+            double entry=StencilEntry(level, i, j, column_shift, row_shift);
+            if(entry==0.0) continue;
+            //P^T A P, each fine column has at most two coarse parents
+            int parents_of_i[2]={left_coarse_columns[i], left_coarse_columns[i]+1};
+            double weights_of_i[2]={left_weights[i], right_weights[i]};
+            int parents_of_neighbour[2]={left_coarse_columns[neighbour_column], left_coarse_columns[neighbour_column]+1};
+            double weights_of_neighbour[2]={left_weights[neighbour_column], right_weights[neighbour_column]};
+            for(int a=0; a<2; a++){
+              if(weights_of_i[a]==0.0) continue;
+              for(int b=0; b<2; b++){
+                if(weights_of_neighbour[b]==0.0) continue;
+                StencilEntry(level+1, parents_of_i[a], j, parents_of_neighbour[b]-parents_of_i[a], row_shift)
+                  += weights_of_i[a]*entry*weights_of_neighbour[b];
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  for(int level=0; level+1<num_of_levels; level++) FactorLines(level);
+  for(int level=0; level+1<num_of_levels; level++)
+    for(int k=0; k<(int)line_pivots_[level].size(); k++)
+      if(!(line_pivots_[level][k]>0.0)) return 1;
+  return FactorCoarsestLevel();
+}
+
+// LDL^T of the tridiagonal block that couples the rows of each column
+void GeometricMultigrid::FactorLines(const int level){
+  for(int i=0; i<num_of_columns_[level]; i++){
+    int first_point=i*num_of_rows_;
+    line_pivots_[level][first_point]=StencilEntry(level, i, 0, 0, 0);
+    for(int j=1; j<num_of_rows_; j++){
+      double coupling=StencilEntry(level, i, j, 0, -1);
+      double multiplier=coupling/line_pivots_[level][first_point+j-1];
+      line_multipliers_[level][first_point+j]=multiplier;
+      line_pivots_[level][first_point+j]=StencilEntry(level, i, j, 0, 0)-multiplier*coupling;
+    }
+  }
+}
+
+// one gauss-seidel pass over the columns, each column solved exactly against the current values of its neighbours
+void GeometricMultigrid::LineGaussSeidelSweep(const int level, const bool is_forward){
+  const double* stencils=stencils_[level].data();
+  const double* right_hand_side=right_hand_sides_[level].data();
+  const double* line_pivots=line_pivots_[level].data();
+  const double* line_multipliers=line_multipliers_[level].data();
+  double* solution=solutions_[level].data();
+  int num_of_columns=num_of_columns_[level];
+  for(int count=0; count<num_of_columns; count++){
+    int i=is_forward?count:num_of_columns-1-count;
+    int first_point=i*num_of_rows_;
+    const double* left_column=(i>0)?solution+first_point-num_of_rows_:NULL;
+    const double* right_column=(i<num_of_columns-1)?solution+first_point+num_of_rows_:NULL;
+    double* column=solution+first_point;
+    for(int j=0; j<num_of_rows_; j++){
+      const double* stencil=stencils+(first_point+j)*kNumOfStencilEntries_;
+      double line_right_hand_side=right_hand_side[first_point+j];
+      if(left_column) line_right_hand_side -= ColumnCouplingProduct(stencil, left_column, j);
+      if(right_column) line_right_hand_side -= ColumnCouplingProduct(stencil+6, right_column, j);
+      if(j>0) line_right_hand_side -= line_multipliers[first_point+j]*column[j-1];
+      column[j]=line_right_hand_side;
+    }
+    for(int j=num_of_rows_-1; j>=0; j--){
+      column[j] /= line_pivots[first_point+j];
+      if(j<num_of_rows_-1) column[j] -= line_multipliers[first_point+j+1]*column[j+1];
+    }
+  }
+}
+
+// band cholesky of the coarsest level, row p holding columns p-coarsest_half_band_width_ to p
+int GeometricMultigrid::FactorCoarsestLevel(){
+  int level=num_of_columns_.size()-1;
+  int num_of_grid_points=num_of_columns_[level]*num_of_rows_;
+  int row_length=coarsest_half_band_width_+1;
+  std::fill(coarsest_band_factor_.begin(), coarsest_band_factor_.end(), 0.0);
+  for(int i=0; i<num_of_columns_[level]; i++){
+    for(int j=0; j<num_of_rows_; j++){
+      int p=i*num_of_rows_+j;
+      for(int column_shift=-1; column_shift<=0; column_shift++){
+        for(int row_shift=-1; row_shift<=1; row_shift++){
+          int q=p+column_shift*num_of_rows_+row_shift;
+          if(i+column_shift<0 || j+row_shift<0 || j+row_shift>=num_of_rows_ || q>p) continue;
+          coarsest_band_factor_[p*row_length+coarsest_half_band_width_-(p-q)]=StencilEntry(level, i, j, column_shift, row_shift);
+        }
+      }
+    }
+  }
+  for(int p=0; p<num_of_grid_points; p++){
+    int first_column=(p>coarsest_half_band_width_)?p-coarsest_half_band_width_:0;
+    for(int q=first_column; q<=p; q++){
+      double temporary_variable=coarsest_band_factor_[p*row_length+coarsest_half_band_width_-(p-q)];
+      int first_common_column=(q>coarsest_half_band_width_)?q-coarsest_half_band_width_:0;
+      if(first_common_column<first_column) first_common_column=first_column;
+      for(int k=first_common_column; k<q; k++)
+        temporary_variable -= coarsest_band_factor_[p*row_length+coarsest_half_band_width_-(p-k)]
+                             *coarsest_band_factor_[q*row_length+coarsest_half_band_width_-(q-k)];
+      if(q<p) 
+        coarsest_band_factor_[p*row_length+coarsest_half_band_width_-(p-q)]=temporary_variable/coarsest_band_factor_[q*row_length+coarsest_half_band_width_];
+      else{
+        if(!(temporary_variable>0.0)) return 1;
+        coarsest_band_factor_[p*row_length+coarsest_half_band_width_]=sqrt(temporary_variable);
+      }
+    }
+  }
+  return 0;
+}
+
+void GeometricMultigrid::SolveCoarsestLevel(){
+  int level=num_of_columns_.size()-1;
+  int num_of_grid_points=num_of_columns_[level]*num_of_rows_;
+  int row_length=coarsest_half_band_width_+1;
+  std::vector<double>& solution=solutions_[level];
+  for(int p=0; p<num_of_grid_points; p++){
+    int first_column=(p>coarsest_half_band_width_)?p-coarsest_half_band_width_:0;
+    double temporary_variable=right_hand_sides_[level][p];
+    for(int k=first_column; k<p; k++)
+      temporary_variable -= coarsest_band_factor_[p*row_length+coarsest_half_band_width_-(p-k)]*solution[k];
+    solution[p]=temporary_variable/coarsest_band_factor_[p*row_length+coarsest_half_band_width_];
+  }
+  for(int p=num_of_grid_points-1; p>=0; p--){
+    int first_column=(p>coarsest_half_band_width_)?p-coarsest_half_band_width_:0;
+    solution[p] /= coarsest_band_factor_[p*row_length+coarsest_half_band_width_];
+    for(int k=first_column; k<p; k++)
+      solution[k] -= coarsest_band_factor_[p*row_length+coarsest_half_band_width_-(p-k)]*solution[p];
+  }
+}
+
+void GeometricMultigrid::VCycle(const int level){
+  if(level==(int)num_of_columns_.size()-1){
+    SolveCoarsestLevel();
+    return;
+  }
+  std::vector<double>& right_hand_side=right_hand_sides_[level];
+  std::vector<double>& solution=solutions_[level];
+  std::vector<double>& residual=residuals_[level];
+  std::vector<int>& left_coarse_columns=left_coarse_columns_[level];
+  std::fill(solution.begin(), solution.end(), 0.0);
+  LineGaussSeidelSweep(level, true);
+
+  int num_of_columns=num_of_columns_[level];
+  for(int i=0; i<num_of_columns; i++){
+    int first_point=i*num_of_rows_;
+    const double* left_column=(i>0)?&solution[first_point-num_of_rows_]:NULL;
+    const double* right_column=(i<num_of_columns-1)?&solution[first_point+num_of_rows_]:NULL;
+    for(int j=0; j<num_of_rows_; j++){
+      const double* stencil=&stencils_[level][(first_point+j)*kNumOfStencilEntries_];
+      double temporary_variable=right_hand_side[first_point+j]-ColumnCouplingProduct(stencil+3, &solution[first_point], j);
+      if(left_column) temporary_variable -= ColumnCouplingProduct(stencil, left_column, j);
+      if(right_column) temporary_variable -= ColumnCouplingProduct(stencil+6, right_column, j);
+      residual[first_point+j]=temporary_variable;
+    }
+  }
+  std::vector<double>& coarse_right_hand_side=right_hand_sides_[level+1];
+  std::fill(coarse_right_hand_side.begin(), coarse_right_hand_side.end(), 0.0);
+  for(int i=0; i<num_of_columns; i++){
+    int left_point=left_coarse_columns[i]*num_of_rows_;
+    for(int j=0; j<num_of_rows_; j++){
+      coarse_right_hand_side[left_point+j] += left_weights_[level][i]*residual[i*num_of_rows_+j];
+      if(right_weights_[level][i]!=0.0) coarse_right_hand_side[left_point+num_of_rows_+j] += right_weights_[level][i]*residual[i*num_of_rows_+j];
+    }
+  }
+
+  VCycle(level+1);
+
+  std::vector<double>& coarse_solution=solutions_[level+1];
+  for(int i=0; i<num_of_columns; i++){
+    int left_point=left_coarse_columns[i]*num_of_rows_;
+    for(int j=0; j<num_of_rows_; j++){
+      solution[i*num_of_rows_+j] += left_weights_[level][i]*coarse_solution[left_point+j];
+      if(right_weights_[level][i]!=0.0) solution[i*num_of_rows_+j] += right_weights_[level][i]*coarse_solution[left_point+num_of_rows_+j];
+    }
+  }
+  LineGaussSeidelSweep(level, false);
+}
+
+// z=M^-1*r for r and z in equation numbering
+void GeometricMultigrid::ApplyVCycle(std::vector<double>& r, std::vector<double>& z){
+  int num_of_grid_points=equation_numbers_of_grid_points_.size();
+  for(int p=0; p<num_of_grid_points; p++){
+    int equation_number=equation_numbers_of_grid_points_[p];
+    right_hand_sides_[0][p]=(equation_number>=0)?r[equation_number]:0.0;
+  }
+  VCycle(0);
+  for(int p=0; p<num_of_grid_points; p++){
+    int equation_number=equation_numbers_of_grid_points_[p];
+    if(equation_number>=0) z[equation_number]=solutions_[0][p];
+  }
+}
+
+// band cholesky in lapack lower band layout, A(i,j) for 0<=i-j<=half_band_width_ at band_[(i-j)+j*(half_band_width_+1)].
+// columns are factored in blocks of block_size_: a dense cholesky of the diagonal block, then the rows below it that reach
+// into the block are copied to a contiguous panel, solved against the block and used for the trailing update. panel rows and
+// trailing update rows are split into tiles of block_size_ rows that run on the thread pool, each tile writing only its own rows.
+class BlockedBandCholesky{
+public:
+  static const int kBlockSize_=32;
+  void InitializeBlockedBandCholesky(std::vector<int>&, int);
+  int Factor(std::vector<double>&, std::vector<int>&);
+  void Solve(std::vector<double>&);
+
+private:
+  double& BandEntry(const int i, const int j)
+    {return band_[(i-j)+j*(half_band_width_+1)];}
+  int FirstBandColumnInPanel(const int i, const int block_start) const
+    {return (i-half_band_width_>block_start)?i-half_band_width_-block_start:0;}
+  int num_of_equations_;
+  int half_band_width_;
+  int block_size_; //kBlockSize_, narrowed to the half band width like lapack's dpbtrf
+  std::vector<double> band_;
+  std::vector<double> panel_; //block and the rows below it, row major with block_size_ columns
+  ThreadPool thread_pool_;
+};
+const int BlockedBandCholesky::kBlockSize_;
+void BlockedBandCholesky::InitializeBlockedBandCholesky(std::vector<int>& accumulative_half_band_width_vector, const int num_of_threads){
+  num_of_equations_=accumulative_half_band_width_vector.size();
+  half_band_width_=0;
+  for(int i=1; i<num_of_equations_; i++){
+    int row_length=accumulative_half_band_width_vector[i]-accumulative_half_band_width_vector[i-1];
+    if(row_length-1>half_band_width_) half_band_width_=row_length-1;
+  }
+  block_size_=(half_band_width_<kBlockSize_)?half_band_width_:kBlockSize_;
+  if(block_size_<1) block_size_=1;
+  band_.assign((half_band_width_+1)*num_of_equations_, 0.0);
+  panel_.assign((half_band_width_+block_size_)*block_size_, 0.0);
+  thread_pool_.InitializeThreadPool(num_of_threads);
+}
+
+// copies the skyline lower triangle into the band and factors it in place. returns 1 if a non-positive pivot is met
+int BlockedBandCholesky::Factor(std::vector<double>& desparsed_matrix, std::vector<int>& accumulative_half_band_width_vector){
+  const int leading_dimension=half_band_width_+1;
+  double*const band=band_.data();
+  double*const panel=panel_.data();
+  std::fill(band_.begin(), band_.end(), 0.0);
+  for(int i=0; i<num_of_equations_; i++){
+    int first_column_of_row_i=(i==0)?0:i-(accumulative_half_band_width_vector[i]-accumulative_half_band_width_vector[i-1])+1;
+    for(int j=first_column_of_row_i; j<=i; j++)
+      band[(i-j)+j*leading_dimension]=desparsed_matrix[accumulative_half_band_width_vector[i]-(i-j)];
+  }
+
+  for(int block_start=0; block_start<num_of_equations_; block_start+=block_size_){
+    const int block_end=(block_start+block_size_<num_of_equations_)?block_start+block_size_:num_of_equations_;
+    const int block_width=block_end-block_start;
+    const int last_row=(block_end-1+half_band_width_<num_of_equations_-1)?block_end-1+half_band_width_:num_of_equations_-1;
+    const int num_of_panel_rows=last_row-block_start+1;
+//   gather the block columns into the panel, row r is equation block_start+r, zero outside the band
+    for(int r=0; r<num_of_panel_rows; r++){
+      int i=block_start+r;
+      for(int c=0; c<block_width; c++){
+        int j=block_start+c;
+        panel[r*block_size_+c]=(i>=j && i-j<=half_band_width_)?band[(i-j)+j*leading_dimension]:0.0;
+      }
+    }
+//   dense cholesky of the diagonal block
+    for(int c=0; c<block_width; c++){
+      double*const row_c=panel+c*block_size_;
+      double diagonal=row_c[c];
+      for(int k=FirstBandColumnInPanel(block_start+c, block_start); k<c; k++) diagonal -= row_c[k]*row_c[k];
+      if(!(diagonal>0.0)) return 1;
+      row_c[c]=sqrt(diagonal);
+      for(int r=c+1; r<block_width; r++){
+        double*const row_r=panel+r*block_size_;
+        double temporary_variable=row_r[c];
+        for(int k=FirstBandColumnInPanel(block_start+r, block_start); k<c; k++) temporary_variable -= row_r[k]*row_c[k];
+        row_r[c]=temporary_variable/row_c[c];
+      }
+    }
+//   rows below the block, L21=A21*L11^-T, one tile of rows per task
+    const int num_of_tiles=(num_of_panel_rows-block_width+block_size_-1)/block_size_;
+    thread_pool_.RunTasks(num_of_tiles, [&](const int tile, const int /*thread_id*/){
+      int tile_end=block_width+(tile+1)*block_size_<num_of_panel_rows?block_width+(tile+1)*block_size_:num_of_panel_rows;
+      for(int r=block_width+tile*block_size_; r<tile_end; r++){
+        double*const row_r=panel+r*block_size_;
+        const int first_k=FirstBandColumnInPanel(block_start+r, block_start);
+        for(int c=first_k; c<block_width; c++){
+          const double*const row_c=panel+c*block_size_;
+          double temporary_variable=row_r[c];
+          for(int k=first_k; k<c; k++) temporary_variable -= row_r[k]*row_c[k];
+          row_r[c]=temporary_variable/row_c[c];
+        }
+      }
+    });
+//   scatter the factored columns back into the band
+    for(int r=0; r<num_of_panel_rows; r++){
+      int i=block_start+r;
+      int first_column=(i-half_band_width_>block_start)?i-half_band_width_:block_start;
+      int last_column=(i<block_end-1)?i:block_end-1;
+      for(int j=first_column; j<=last_column; j++)
+        band[(i-j)+j*leading_dimension]=panel[r*block_size_+(j-block_start)];
+    }
+//   trailing update A22-=L21*L21^T inside the band, each tile writes only its own rows
+    thread_pool_.RunTasks(num_of_tiles, [&](const int tile, const int /*thread_id*/){
+      int tile_end=block_width+(tile+1)*block_size_<num_of_panel_rows?block_width+(tile+1)*block_size_:num_of_panel_rows;
+      for(int r=block_width+tile*block_size_; r<tile_end; r++){
+        int i=block_start+r;
+        const double*const row_i=panel+r*block_size_;
+        const int first_k=FirstBandColumnInPanel(i, block_start); //row i is zero left of it, row j<=i as well
+        int first_column=(i-half_band_width_>block_end)?i-half_band_width_:block_end;
+        for(int j=first_column; j<=i; j++){
+          const double*const row_j=panel+(j-block_start)*block_size_;
+          double dot_product=0.0;
+          for(int k=first_k; k<block_width; k++) dot_product += row_i[k]*row_j[k];
+          band[(i-j)+j*leading_dimension] -= dot_product;
+        }
+      }
+    });
+  }
+  return 0;
+}
+
+// solves L*L^T*x=b with the band factor, b is overwritten by x
+void BlockedBandCholesky::Solve(std::vector<double>& right_hand_side){
+  for(int j=0; j<num_of_equations_; j++){
+    right_hand_side[j] /= BandEntry(j,j);
+    int last_row=(j+half_band_width_<num_of_equations_-1)?j+half_band_width_:num_of_equations_-1;
+    const double* column=&band_[j*(half_band_width_+1)];
+    for(int i=j+1; i<=last_row; i++) right_hand_side[i] -= column[i-j]*right_hand_side[j];
+  }
+  for(int j=num_of_equations_-1; j>=0; j--){
+    int last_row=(j+half_band_width_<num_of_equations_-1)?j+half_band_width_:num_of_equations_-1;
+    const double* column=&band_[j*(half_band_width_+1)];
+    double temporary_variable=right_hand_side[j];
+    for(int i=j+1; i<=last_row; i++) temporary_variable -= column[i-j]*right_hand_side[i];
+    right_hand_side[j]=temporary_variable/column[0];
+  }
+}
+
+// dot product of two profile rows with eight independent partial sums, so the compiler can keep them in vector registers
+// without reassociating one running sum. in single precision the same registers hold twice as many terms
+template<typename Real>
+inline Real SkylineDotProduct(const Real* a, const Real* b, const int length){
+  Real partial_sums[8]={0,0,0,0,0,0,0,0};
+  int k=0;
+  for(; k+8<=length; k+=8)
+    for(int l=0; l<8; l++) partial_sums[l] += a[k+l]*b[k+l];
+  Real sum=((partial_sums[0]+partial_sums[4])+(partial_sums[1]+partial_sums[5]))+
+    ((partial_sums[2]+partial_sums[6])+(partial_sums[3]+partial_sums[7]));
+  for(; k<length; k++) sum += a[k]*b[k];
+  return sum;
+}
+
+// sparse cholesky of the symmetric tangent on the element pattern. the equations are permuted by nested dissection once
+// at setup (recursive bisection with the middle level of a breadth first search from a pseudo-peripheral node as the
+// separator, numbered after both halves), and the symbolic factorization is kept: the column structure of L, and for
+// every row the columns it couples to in elimination tree order with the slot each entry of L goes to. a factorization
+// is then numeric only, an up-looking pass over the rows.
+class SparseCholesky{
+public:
+  static const int kMinSubgraphSize_=16; //subgraphs up to this size are not bisected further
+  void InitializeSparseCholesky(std::vector<int>&, std::vector<int>&, std::vector<int>&);
+  int Factor(std::vector<double>&);
+  void Solve(std::vector<double>&);
+  int get_num_of_factor_entries() const
+    {return factor_column_starts_[num_of_equations_];}
+
+private:
+  void NestedDissectionOrdering(std::vector<int>&, std::vector<int>&);
+  int num_of_equations_;
+  std::vector<int> permutation_; //permutation_[new equation]=old equation
+  //lower triangle of the permuted matrix by rows, with the skyline offset of every entry
+  std::vector<int> matrix_row_starts_;
+  std::vector<int> matrix_columns_;
+  std::vector<int> matrix_offsets_;
+  //symbolic factorization, L by columns with the diagonal first in each
+  std::vector<int> factor_column_starts_;
+  std::vector<int> factor_rows_;
+  std::vector<double> factor_values_;
+  std::vector<int> row_pattern_starts_;
+  std::vector<int> row_pattern_columns_;
+  std::vector<int> row_pattern_slots_;
+  std::vector<double> work_;
+};
+const int SparseCholesky::kMinSubgraphSize_;
+
+// row_starts, columns and offsets hold the lower triangle of the element pattern by rows and the skyline offset of each entry
+void SparseCholesky::InitializeSparseCholesky(std::vector<int>& row_starts, std::vector<int>& columns, std::vector<int>& offsets){
+  num_of_equations_=row_starts.size()-1;
+  const int n=num_of_equations_;
+  std::vector<int> adjacency_starts(n+1,0);
+  for(int i=0; i<n; i++)
+    for(int p=row_starts[i]; p<row_starts[i+1]; p++)
+      if(columns[p]!=i){
+        adjacency_starts[i+1]++;
+        adjacency_starts[columns[p]+1]++;
+      }
+  for(int i=0; i<n; i++) adjacency_starts[i+1] += adjacency_starts[i];
+  std::vector<int> adjacency(adjacency_starts[n]);
+  std::vector<int> next_slot(adjacency_starts.begin(), adjacency_starts.end()-1);
+  for(int i=0; i<n; i++)
+    for(int p=row_starts[i]; p<row_starts[i+1]; p++)
+      if(columns[p]!=i){
+        adjacency[next_slot[i]++]=columns[p];
+        adjacency[next_slot[columns[p]]++]=i;
+      }
+  permutation_.assign(n,0);
+  NestedDissectionOrdering(adjacency_starts, adjacency);
+  std::vector<int> inverse_permutation(n);
+  for(int k=0; k<n; k++) inverse_permutation[permutation_[k]]=k;
+
+//  permuted lower triangle, entry (k,j) with j<=k read from old (i,l) or (l,i), whichever is stored
+  matrix_row_starts_.assign(n+1,0);
+  matrix_columns_.clear();
+  matrix_offsets_.clear();
+  for(int i=0; i<n; i++)
+    for(int p=row_starts[i]; p<row_starts[i+1]; p++){
+      int k=inverse_permutation[i], j=inverse_permutation[columns[p]];
+      matrix_row_starts_[((j>k)?j:k)+1]++;
+    }
+  for(int k=0; k<n; k++) matrix_row_starts_[k+1] += matrix_row_starts_[k];
+  matrix_columns_.resize(matrix_row_starts_[n]);
+  matrix_offsets_.resize(matrix_row_starts_[n]);
+  next_slot.assign(matrix_row_starts_.begin(), matrix_row_starts_.end()-1);
+  for(int i=0; i<n; i++)
+    for(int p=row_starts[i]; p<row_starts[i+1]; p++){
+      int k=inverse_permutation[i], j=inverse_permutation[columns[p]];
+      int row=(j>k)?j:k;
+      matrix_columns_[next_slot[row]]=(j>k)?k:j;
+      matrix_offsets_[next_slot[row]++]=offsets[p];
+    }
+
+//  elimination tree, with path compression through virtual ancestors
+  std::vector<int> parent(n,-1), ancestor(n,-1);
+  for(int k=0; k<n; k++)
+    for(int p=matrix_row_starts_[k]; p<matrix_row_starts_[k+1]; p++){
+      for(int i=matrix_columns_[p]; i!=-1 && i<k; ){
+        int next_ancestor=ancestor[i];
+        ancestor[i]=k;
+        if(next_ancestor==-1) parent[i]=k;
+        i=next_ancestor;
+      }
+    }
+
+//  row patterns of L: row k reaches from its matrix entries up the tree until a node already seen for k. each path is
+//  pushed ahead of the earlier ones, so every column comes after the columns it is updated by
+  std::vector<int> flag(n,-1), path(n), stack(n);
+  std::vector<int> column_counts(n,1);
+  row_pattern_starts_.assign(n+1,0);
+  row_pattern_columns_.clear();
+  for(int k=0; k<n; k++){
+    int top=n;
+    flag[k]=k;
+    for(int p=matrix_row_starts_[k]; p<matrix_row_starts_[k+1]; p++){
+      int length=0;
+      for(int i=matrix_columns_[p]; flag[i]!=k; i=parent[i]){
+        path[length++]=i;
+        flag[i]=k;
+      }
+      while(length>0) stack[--top]=path[--length];
+    }
+    for(int t=top; t<n; t++){
+      row_pattern_columns_.push_back(stack[t]);
+      column_counts[stack[t]]++;
+    }
+    row_pattern_starts_[k+1]=row_pattern_columns_.size();
+  }
+  factor_column_starts_.assign(n+1,0);
+  for(int j=0; j<n; j++) factor_column_starts_[j+1]=factor_column_starts_[j]+column_counts[j];
+  factor_rows_.resize(factor_column_starts_[n]);
+  factor_values_.assign(factor_column_starts_[n],0.0);
+  row_pattern_slots_.resize(row_pattern_columns_.size());
+  for(int j=0; j<n; j++){
+    factor_rows_[factor_column_starts_[j]]=j;
+    next_slot[j]=factor_column_starts_[j]+1;
+  }
+  for(int k=0; k<n; k++)
+    for(int t=row_pattern_starts_[k]; t<row_pattern_starts_[k+1]; t++){
+      int j=row_pattern_columns_[t];
+      row_pattern_slots_[t]=next_slot[j];
+      factor_rows_[next_slot[j]++]=k;
+    }
+  work_.assign(n,0.0);
+}
+
+// fills permutation_ so that each separator follows the two parts it splits
+void SparseCholesky::NestedDissectionOrdering(std::vector<int>& adjacency_starts, std::vector<int>& adjacency){
+  const int n=num_of_equations_;
+  std::vector<int> subgraph_of_node(n,0), level_of_node(n,-1);
+  std::vector<int> queue;
+  queue.reserve(n);
+//  each pending subgraph: its nodes and the first new number of the range it occupies
+  std::vector<std::pair<std::vector<int>,int> > pending;
+  pending.push_back(std::make_pair(std::vector<int>(), 0));
+  for(int i=0; i<n; i++) pending.back().first.push_back(i);
+  int num_of_subgraphs=1;
+  while(!pending.empty()){
+    std::vector<int> nodes;
+    nodes.swap(pending.back().first);
+    int first_number=pending.back().second;
+    pending.pop_back();
+    int subgraph=subgraph_of_node[nodes[0]];
+    if((int)nodes.size()<=kMinSubgraphSize_){
+      for(int t=0; t<(int)nodes.size(); t++) permutation_[first_number+t]=nodes[t];
+      continue;
+    }
+//   breadth first level structure inside the subgraph, restarted from a far node of least degree until it gets no deeper
+    int root=nodes[0], num_of_levels=0;
+    for(int attempt=0; attempt<8; attempt++){
+      queue.clear();
+      queue.push_back(root);
+      level_of_node[root]=0;
+      for(int head=0; head<(int)queue.size(); head++){
+        int i=queue[head];
+        for(int p=adjacency_starts[i]; p<adjacency_starts[i+1]; p++){
+          int l=adjacency[p];
+          if(subgraph_of_node[l]==subgraph && level_of_node[l]<0){
+            level_of_node[l]=level_of_node[i]+1;
+            queue.push_back(l);
+          }
+        }
+      }
+      int depth=level_of_node[queue.back()]+1;
+      int far_node=queue.back();
+      for(int t=queue.size()-1; t>=0 && level_of_node[queue[t]]==depth-1; t--)
+        if(adjacency_starts[queue[t]+1]-adjacency_starts[queue[t]]<adjacency_starts[far_node+1]-adjacency_starts[far_node])
+          far_node=queue[t];
+      bool is_deeper=depth>num_of_levels;
+      if(is_deeper){
+        num_of_levels=depth;
+        root=far_node;
+      }
+      if(!is_deeper || attempt==7) break;
+      for(int t=0; t<(int)queue.size(); t++) level_of_node[queue[t]]=-1;
+    }
+//   queue holds the component of the last search, its levels are still set
+    if(queue.size()<nodes.size()){
+//     disconnected, the component and the rest are independent and need no separator
+      std::vector<int> rest;
+      for(int t=0; t<(int)nodes.size(); t++)
+        if(level_of_node[nodes[t]]<0) rest.push_back(nodes[t]);
+      for(int t=0; t<(int)queue.size(); t++){
+        level_of_node[queue[t]]=-1;
+        subgraph_of_node[queue[t]]=num_of_subgraphs;
+      }
+      for(int t=0; t<(int)rest.size(); t++) subgraph_of_node[rest[t]]=num_of_subgraphs+1;
+      num_of_subgraphs+=2;
+      int size_of_component=queue.size();
+      pending.push_back(std::make_pair(std::vector<int>(queue.begin(), queue.end()), first_number));
+      pending.push_back(std::make_pair(rest, first_number+size_of_component));
+      continue;
+    }
+    int depth=level_of_node[queue.back()]+1;
+    if(depth<3){
+      for(int t=0; t<(int)queue.size(); t++){
+        permutation_[first_number+t]=queue[t];
+        level_of_node[queue[t]]=-1;
+      }
+      continue;
+    }
+//   the level where the running count passes half the subgraph separates the levels above from those below
+    int separator_level=1;
+    for(int t=0, count=0; t<(int)queue.size(); t++){
+      if(++count*2>=(int)queue.size()){
+        separator_level=level_of_node[queue[t]];
+        break;
+      }
+    }
+    if(separator_level<1) separator_level=1;
+    if(separator_level>depth-2) separator_level=depth-2;
+    std::vector<int> first_part, second_part, separator;
+    for(int t=0; t<(int)queue.size(); t++){
+      int i=queue[t];
+      if(level_of_node[i]<separator_level) first_part.push_back(i);
+      else if(level_of_node[i]>separator_level) second_part.push_back(i);
+      else separator.push_back(i);
+      level_of_node[i]=-1;
+    }
+    for(int t=0; t<(int)first_part.size(); t++) subgraph_of_node[first_part[t]]=num_of_subgraphs;
+    for(int t=0; t<(int)second_part.size(); t++) subgraph_of_node[second_part[t]]=num_of_subgraphs+1;
+    for(int t=0; t<(int)separator.size(); t++){
+      subgraph_of_node[separator[t]]=-1;
+      permutation_[first_number+first_part.size()+second_part.size()+t]=separator[t];
+    }
+    num_of_subgraphs+=2;
+    int size_of_first_part=first_part.size();
+    pending.push_back(std::make_pair(first_part, first_number));
+    pending.push_back(std::make_pair(second_part, first_number+size_of_first_part));
+  }
+}
+
+// numeric factorization on the stored symbolic structure, returns 1 if a non-positive pivot is met
+int SparseCholesky::Factor(std::vector<double>& desparsed_matrix){
+  const int*const column_starts=factor_column_starts_.data();
+  const int*const rows=factor_rows_.data();
+  double*const values=factor_values_.data();
+  double*const x=work_.data();
+  for(int k=0; k<num_of_equations_; k++){
+    for(int p=matrix_row_starts_[k]; p<matrix_row_starts_[k+1]; p++)
+      x[matrix_columns_[p]]=desparsed_matrix[matrix_offsets_[p]];
+    double diagonal=x[k];
+    x[k]=0.0;
+    for(int t=row_pattern_starts_[k]; t<row_pattern_starts_[k+1]; t++){
+      int j=row_pattern_columns_[t];
+      int slot=row_pattern_slots_[t];
+      double l_kj=x[j]/values[column_starts[j]];
+      x[j]=0.0;
+      for(int p=column_starts[j]+1; p<slot; p++) x[rows[p]] -= values[p]*l_kj;
+      diagonal -= l_kj*l_kj;
+      values[slot]=l_kj;
+    }
+    if(!(diagonal>0.0)) return 1;
+    values[column_starts[k]]=sqrt(diagonal);
+  }
+  return 0;
+}
+
+// solves L*L^T*x=b in the permuted numbering, b is overwritten by x
+void SparseCholesky::Solve(std::vector<double>& right_hand_side){
+  const int*const column_starts=factor_column_starts_.data();
+  const int*const rows=factor_rows_.data();
+  const double*const values=factor_values_.data();
+  double*const x=work_.data();
+  for(int k=0; k<num_of_equations_; k++) x[k]=right_hand_side[permutation_[k]];
+  for(int j=0; j<num_of_equations_; j++){
+    x[j] /= values[column_starts[j]];
+    for(int p=column_starts[j]+1; p<column_starts[j+1]; p++) x[rows[p]] -= values[p]*x[j];
+  }
+  for(int j=num_of_equations_-1; j>=0; j--){
+    double temporary_variable=x[j];
+    for(int p=column_starts[j]+1; p<column_starts[j+1]; p++) temporary_variable -= values[p]*x[rows[p]];
+    x[j]=temporary_variable/values[column_starts[j]];
+  }
+  for(int k=0; k<num_of_equations_; k++){
+    right_hand_side[permutation_[k]]=x[k];
+    x[k]=0.0;
+  }
+}
+
 class Solver{
 public:
+  void InitializeSolver(DegreeOfFreedomAndEquationNumbers *const, std::vector<int>&, GeometricMultigrid *const=NULL, 
+  ParallelAssembly *const=NULL);
   double NormOfVector(std::vector<double>&);
-  int LinearEquationsSolver(GlobalVectorsAndMatrices *);
+  int LinearEquationsSolver(GlobalVectorsAndMatrices *, double);
+  void ResetContractionHistory()
+    {residual_norm_of_last_solve_=-1.0;}
+  void PrintLinearSolverStatistics(){
+    if(Constants::kLinearSolverBackend_==1)
+      printf("%d conjugate gradient solves, %d iterations in total\n", num_of_krylov_solves_, num_of_krylov_iterations_);
+    else if(Constants::kLinearSolverBackend_==2)
+      printf("%d jacobian-free newton-krylov solves, %d gmres iterations in total, %d preconditioner rebuilds\n", 
+        num_of_krylov_solves_, num_of_krylov_iterations_, num_of_factorizations_);
+    else
+      printf("%d jacobian factorizations, %d solves reused a factorization\n", num_of_factorizations_, num_of_reused_factorizations_);
+    if(Constants::kUseMixedPrecisionFactorization_)
+      printf("single precision factors, %d refinement steps in double precision\n", num_of_refinement_steps_);
+    if(num_of_shifted_factorizations_>0)
+      printf("%d factorizations recovered with a diagonal shift\n", num_of_shifted_factorizations_);
+  }
+  int get_num_of_sparse_factor_entries() const
+    {return sparse_cholesky_.get_num_of_factor_entries();}
+  int PreconditionedConjugateGradient(std::vector<double>&, std::vector<int>&, std::vector<double>&, std::vector<double>&);
+  void SparseSymmetricMatrixVectorProduct(std::vector<double>&, std::vector<double>&, std::vector<double>&);
+  int IncompleteCholeskyDecomposition(std::vector<double>&, double);
+  void ApplyPreconditioner(std::vector<double>&, std::vector<double>&);
+  int JacobianFreeNewtonKrylov(GlobalVectorsAndMatrices *, double);
+  void FiniteDifferenceJacobianProduct(GlobalVectorsAndMatrices *, double, std::vector<double>&, std::vector<double>&);
+  //the skyline kernels run on the double jacobian or on its single precision copy
+  template<typename Real> int SkylineCholeskyDecomposition(std::vector<Real>&, std::vector<int>&);
+  template<typename Real> void SkylineForwardAndBackwardSubstitution(std::vector<Real>&, std::vector<int>&, std::vector<double>&);
+  template<typename Real> int SkylineLUDecomposition(std::vector<Real>&, std::vector<Real>&, std::vector<int>&);
+  template<typename Real> void SkylineLUForwardAndBackwardSubstitution(std::vector<Real>&, std::vector<Real>&, std::vector<int>&, 
+  std::vector<double>&);
+  void SkylineMatrixVectorProduct(std::vector<double>&, std::vector<double>&, std::vector<int>&, std::vector<double>&, 
+  std::vector<double>&);
+  int FactorSkylineJacobian(std::vector<double>&, std::vector<double>&, std::vector<int>&, std::vector<double>&, std::vector<double>&);
+  template<typename Real> int FactorScaledSkylineCopy(std::vector<double>&, std::vector<double>&, std::vector<int>&, std::vector<Real>&, 
+  std::vector<Real>&, double);
+  void ApplySkylineFactor(std::vector<double>&, std::vector<double>&, std::vector<int>&, std::vector<double>&);
+  void RefinedSkylineSolve(std::vector<double>&, std::vector<double>&, std::vector<int>&, std::vector<double>&, std::vector<double>&, 
+  std::vector<double>&);
+
+private:
+  //modified newton keeps the factor apart from the jacobian, which is reassembled every iteration
+  std::vector<double> factorized_jacobian_;
+  std::vector<double> factorized_jacobian_upper_;
+  bool is_factorization_valid_;
+  double factorized_time_increment_;
+  double residual_norm_of_last_solve_;
+  int num_of_factorizations_;
+  int num_of_reused_factorizations_;
+  //mixed precision keeps the jacobian in double for the refinement residual and factors a single precision copy
+  std::vector<float> single_precision_factor_;
+  std::vector<float> single_precision_factor_upper_;
+  int num_of_refinement_steps_;
+  //row scaling of the equilibrated factor, and whether the factor carries a recovery shift
+  std::vector<double> equilibration_scales_;
+  bool is_factor_shifted_;
+  int num_of_shifted_factorizations_;
+  //conjugate gradient works on the element couplings inside the skyline profile, row i holding its columns j<=i in ascending
+  //order (diagonal last) with the profile offset of each
+  std::vector<int> pattern_row_starts_;
+  std::vector<int> pattern_columns_;
+  std::vector<int> pattern_offsets_;
+  std::vector<double> preconditioner_values_;
+  std::vector<double> residual_;
+  std::vector<double> preconditioned_residual_;
+  std::vector<double> search_direction_;
+  std::vector<double> matrix_times_search_direction_;
+  std::vector<double> iterate_;
+  int num_of_krylov_solves_;
+  int num_of_krylov_iterations_;
+  GeometricMultigrid* geometric_multigrid_;
+  BlockedBandCholesky blocked_band_cholesky_;
+  SparseCholesky sparse_cholesky_;
+  //jacobian-free newton-krylov: residual at the current iterate, the gmres basis and its least squares problem
+  ParallelAssembly* parallel_assembly_;
+  std::vector<int>* equation_numbers_of_nodes_;
+  std::vector<double> base_residual_;
+  std::vector<double> unperturbed_temperature_field_;
+  std::vector<std::vector<double> > krylov_basis_;
+  std::vector<double> hessenberg_matrix_; //(restart+1) x restart, column major
+  std::vector<double> givens_cosines_;
+  std::vector<double> givens_sines_;
+  std::vector<double> least_squares_right_hand_side_;
+  int num_of_krylov_iterations_of_last_solve_;
 };
+void Solver::InitializeSolver(DegreeOfFreedomAndEquationNumbers *const dof_and_equation_numbers, 
+std::vector<int>& accumulative_half_band_width_vector, GeometricMultigrid *const geometric_multigrid, 
+ParallelAssembly *const parallel_assembly){
+  geometric_multigrid_=geometric_multigrid;
+  parallel_assembly_=parallel_assembly;
+  equation_numbers_of_nodes_=&(*dof_and_equation_numbers).get_equation_numbers_of_nodes();
+  num_of_krylov_iterations_of_last_solve_=0;
+  factorized_jacobian_.clear();
+  factorized_jacobian_upper_.clear();
+  is_factorization_valid_=false;
+  factorized_time_increment_=0.0;
+  residual_norm_of_last_solve_=-1.0;
+  num_of_factorizations_=0;
+  num_of_reused_factorizations_=0;
+  num_of_refinement_steps_=0;
+  is_factor_shifted_=false;
+  num_of_shifted_factorizations_=0;
+  num_of_krylov_solves_=0;
+  num_of_krylov_iterations_=0;
+  int num_of_equations=accumulative_half_band_width_vector.size();
+  single_precision_factor_.clear();
+  single_precision_factor_upper_.clear();
+  if(Constants::kUseMixedPrecisionFactorization_ || Constants::kUsePivotShiftRecovery_){
+    residual_.assign(num_of_equations,0.0);
+    iterate_.assign(num_of_equations,0.0);
+    matrix_times_search_direction_.assign(num_of_equations,0.0);
+  }
+  if(Constants::kLinearSolverBackend_==3){
+    blocked_band_cholesky_.InitializeBlockedBandCholesky(accumulative_half_band_width_vector, Constants::kNumOfFactorizationThreads_);
+    return;
+  }
+  if(Constants::kLinearSolverBackend_==2){
+    base_residual_.assign(num_of_equations,0.0);
+    krylov_basis_.assign(Constants::kGmresRestart_+1, std::vector<double>(num_of_equations,0.0));
+    hessenberg_matrix_.assign((Constants::kGmresRestart_+1)*Constants::kGmresRestart_,0.0);
+    givens_cosines_.assign(Constants::kGmresRestart_,0.0);
+    givens_sines_.assign(Constants::kGmresRestart_,0.0);
+    least_squares_right_hand_side_.assign(Constants::kGmresRestart_+1,0.0);
+    residual_.assign(num_of_equations,0.0);
+    preconditioned_residual_.assign(num_of_equations,0.0);
+    matrix_times_search_direction_.assign(num_of_equations,0.0);
+    iterate_.assign(num_of_equations,0.0);
+    return;
+  }
+  if(Constants::kLinearSolverBackend_!=1 && Constants::kLinearSolverBackend_!=4) return;
+
+  std::vector<int>& equation_numbers_in_elements=(*dof_and_equation_numbers).get_equation_numbers_in_elements();
+  int num_of_elements=equation_numbers_in_elements.size()/Constants::kNumOfNodesInElement_;
+  std::vector<std::vector<int> > columns_of_rows(num_of_equations);
+  for(int e=0; e<num_of_elements; e++){
+    for(int a=0; a<Constants::kNumOfNodesInElement_; a++){
+      int row=equation_numbers_in_elements[a+e*Constants::kNumOfNodesInElement_];
+      if(row<0) continue;
+      for(int b=0; b<Constants::kNumOfNodesInElement_; b++){
+        int column=equation_numbers_in_elements[b+e*Constants::kNumOfNodesInElement_];
+        if(column>=0 && column<=row) columns_of_rows[row].push_back(column);
+      }
+    }
+  }
+  pattern_row_starts_.assign(num_of_equations+1,0);
+  pattern_columns_.clear();
+  pattern_offsets_.clear();
+  for(int i=0; i<num_of_equations; i++){
+    std::sort(columns_of_rows[i].begin(), columns_of_rows[i].end());
+    columns_of_rows[i].erase(std::unique(columns_of_rows[i].begin(), columns_of_rows[i].end()), columns_of_rows[i].end());
+    for(int k=0; k<(int)columns_of_rows[i].size(); k++){
+      pattern_columns_.push_back(columns_of_rows[i][k]);
+      pattern_offsets_.push_back(accumulative_half_band_width_vector[i]-(i-columns_of_rows[i][k]));
+    }
+    pattern_row_starts_[i+1]=pattern_columns_.size();
+  }
+  if(Constants::kLinearSolverBackend_==4){
+    sparse_cholesky_.InitializeSparseCholesky(pattern_row_starts_, pattern_columns_, pattern_offsets_);
+    return;
+  }
+  preconditioner_values_.assign(pattern_columns_.size(),0.0);
+  residual_.assign(num_of_equations,0.0);
+  preconditioned_residual_.assign(num_of_equations,0.0);
+  search_direction_.assign(num_of_equations,0.0);
+  matrix_times_search_direction_.assign(num_of_equations,0.0);
+  iterate_.assign(num_of_equations,0.0);
+}
 double Solver::NormOfVector(std::vector<double>& vector_to_be_evaluated){
   double return_value=0.0;
   double summation_over_squred_components=0.0;
@@ -1931,57 +4160,594 @@ double Solver::NormOfVector(std::vector<double>& vector_to_be_evaluated){
 return return_value;
 }
 
-int Solver::LinearEquationsSolver(GlobalVectorsAndMatrices *global_vectors_and_matrices){
+int Solver::LinearEquationsSolver(GlobalVectorsAndMatrices *global_vectors_and_matrices, const double time_increment){
 //use LinearEquationsSolver to solve equations
-  int num_of_equations = ((*global_vectors_and_matrices).get_right_hand_side_function()).size();
-  double temporary_variable, new_value;
-//   decomposition 
-  for(int k=0; k<num_of_equations; k++){   
-    temporary_variable = 0.0;   
-    for(int i=0; i<k; i++){   
-      temporary_variable += (((*global_vectors_and_matrices).JacobianMatrixIndex(i,k))*
-                            ((*global_vectors_and_matrices).JacobianMatrixIndex(i,k)));  
-    }
-    new_value=(double)sqrt( ((*global_vectors_and_matrices).JacobianMatrixIndex(k,k)) - temporary_variable);
-    if(((*global_vectors_and_matrices).ModifyJacobianMatrixIndex(k,k,new_value))) return 1;
-    for(int i=k+1; i<num_of_equations+1; i++){   
-      temporary_variable = 0.0;   
-      for(int j=0; j<k; j++){   
-        temporary_variable += ((*global_vectors_and_matrices).JacobianMatrixIndex(j,k))
-                             *((*global_vectors_and_matrices).JacobianMatrixIndex(j,i));   
-      }   
-      new_value= (((*global_vectors_and_matrices).JacobianMatrixIndex(k,i))-temporary_variable)
-                 /((*global_vectors_and_matrices).JacobianMatrixIndex(k,k));
-      if(((*global_vectors_and_matrices).ModifyJacobianMatrixIndex(k,i,new_value))) return 1;   
-    }   
-  }   
-
-//  back substitution   
-  new_value= ((*global_vectors_and_matrices).JacobianMatrixIndex(num_of_equations-1,num_of_equations)) 
-             /((*global_vectors_and_matrices).JacobianMatrixIndex(num_of_equations-1,num_of_equations-1));
-  if(((*global_vectors_and_matrices).ModifyJacobianMatrixIndex(num_of_equations-1,num_of_equations,new_value))) return 1;
-  
-  for(int k=num_of_equations-2; k>=0; k--){   
-    temporary_variable = 0;   
-    for(int i=k+1; i<num_of_equations; i++){   
-      temporary_variable +=  ((*global_vectors_and_matrices).JacobianMatrixIndex(k,i))
-                           *((*global_vectors_and_matrices).JacobianMatrixIndex(i,num_of_equations));   
-    }   
-
-    new_value=(((*global_vectors_and_matrices).JacobianMatrixIndex(k,num_of_equations)) - temporary_variable) 
-              /((*global_vectors_and_matrices).JacobianMatrixIndex(k,k)); 
-    if(((*global_vectors_and_matrices).ModifyJacobianMatrixIndex(k,num_of_equations,new_value))) return 1;   
-  }   
+  std::vector<double>& jacobian_matrix_global=(*global_vectors_and_matrices).get_jacobian_matrix_global();
+  std::vector<double>& jacobian_upper_matrix_global=(*global_vectors_and_matrices).get_jacobian_upper_matrix_global();
+  std::vector<double>& right_hand_side_function=(*global_vectors_and_matrices).get_right_hand_side_function();
+  std::vector<int>& accumulative_half_band_width_vector=(*global_vectors_and_matrices).get_accumulative_half_band_width_vector();
+  int num_of_equations = right_hand_side_function.size();
+
+  if(Constants::kLinearSolverBackend_==2){
+    if(JacobianFreeNewtonKrylov(global_vectors_and_matrices, time_increment)) return 1;
+    for(int i=0; i<num_of_equations; i++)
+      (*global_vectors_and_matrices).get_solution_of_last_iteration()[i]=right_hand_side_function[i];
+    return 0;
+  }
+  if(Constants::kLinearSolverBackend_==1){
+//   warm start from the previous newton increment, the solution overwrites the right hand side
+    if(PreconditionedConjugateGradient(jacobian_matrix_global, accumulative_half_band_width_vector, right_hand_side_function, 
+       (*global_vectors_and_matrices).get_solution_of_last_iteration())) return 1;
+    for(int i=0; i<num_of_equations; i++)
+      (*global_vectors_and_matrices).get_solution_of_last_iteration()[i]=right_hand_side_function[i];
+    return 0;
+  }
+
+  //modified newton, and shift recovery with its refinement, need the assembled jacobian to outlive the factorization
+  bool is_jacobian_kept=Constants::kUseModifiedNewton_ || Constants::kUsePivotShiftRecovery_;
+  std::vector<double>* lower_factor=is_jacobian_kept?&factorized_jacobian_:&jacobian_matrix_global;
+  std::vector<double>* upper_factor=is_jacobian_kept?&factorized_jacobian_upper_:&jacobian_upper_matrix_global;
+  bool is_refactorization_needed=true;
+  if(Constants::kUseModifiedNewton_){
+//   the old factor stays while the time increment is unchanged and the last solve contracted the residual fast enough
+    double residual_norm=NormOfVector(right_hand_side_function);
+    is_refactorization_needed = !is_factorization_valid_ || time_increment!=factorized_time_increment_ || 
+      (residual_norm_of_last_solve_>0.0 && residual_norm>Constants::kModifiedNewtonContractionThreshold_*residual_norm_of_last_solve_);
+    residual_norm_of_last_solve_=residual_norm;
+  }
+
+  if(is_refactorization_needed){
+    is_factorization_valid_=false;
+//   decomposition, the stored matrix is overwritten by its factor
+    int is_singular;
+    if(Constants::kLinearSolverBackend_==3)
+      is_singular=blocked_band_cholesky_.Factor(jacobian_matrix_global, accumulative_half_band_width_vector);
+    else if(Constants::kLinearSolverBackend_==4)
+      is_singular=sparse_cholesky_.Factor(jacobian_matrix_global);
+    else
+      is_singular=FactorSkylineJacobian(jacobian_matrix_global, jacobian_upper_matrix_global, accumulative_half_band_width_vector, 
+        *lower_factor, *upper_factor);
+    if(is_singular) return 1;
+    is_factorization_valid_=true;
+    factorized_time_increment_=time_increment;
+    ++num_of_factorizations_;
+  }
+  else ++num_of_reused_factorizations_;
+
+//  forward and back substitution, right hand side is overwritten by the solution
+  if(Constants::kLinearSolverBackend_==3)
+    blocked_band_cholesky_.Solve(right_hand_side_function);
+  else if(Constants::kLinearSolverBackend_==4)
+    sparse_cholesky_.Solve(right_hand_side_function);
+  else if(Constants::kUseMixedPrecisionFactorization_ || is_factor_shifted_)
+    RefinedSkylineSolve(jacobian_matrix_global, jacobian_upper_matrix_global, accumulative_half_band_width_vector, 
+      *lower_factor, *upper_factor, right_hand_side_function);
+  else
+    ApplySkylineFactor(*lower_factor, *upper_factor, accumulative_half_band_width_vector, right_hand_side_function);
 
 //  store disp into solution_of_last_iteration vector/
   for(int i=0; i<num_of_equations; i++){   
-    (*global_vectors_and_matrices).get_solution_of_last_iteration()[i]=((*global_vectors_and_matrices).JacobianMatrixIndex(i,num_of_equations));   
+    (*global_vectors_and_matrices).get_solution_of_last_iteration()[i]=right_hand_side_function[i];   
   }
   
 //  printf("Solving linear equations completed......\n");
   return 0;
 }  
 
+// skyline (profile) cholesky decomposition A=L*L^T. row i of the lower triangle is stored contiguously from its first nonzero 
+// column up to the diagonal, so that A(i,j) sits at accumulative_half_band_width_vector[i]-(i-j). only entries inside the profile
+// are touched; fill never leaves the profile. returns 1 if a non-positive pivot is met.
+template<typename Real>
+int Solver::SkylineCholeskyDecomposition(std::vector<Real>& desparsed_matrix, std::vector<int>& accumulative_half_band_width_vector){
+  int num_of_equations = accumulative_half_band_width_vector.size();
+  for(int i=0; i<num_of_equations; i++){
+    int offset_of_row_i=accumulative_half_band_width_vector[i]-i;
+    int first_column_of_row_i=(i==0)?0:i-(accumulative_half_band_width_vector[i]-accumulative_half_band_width_vector[i-1])+1;
+    for(int j=first_column_of_row_i; j<i; j++){
+      int offset_of_row_j=accumulative_half_band_width_vector[j]-j;
+      int first_column_of_row_j=(j==0)?0:j-(accumulative_half_band_width_vector[j]-accumulative_half_band_width_vector[j-1])+1;
+      int first_common_column=(first_column_of_row_i>first_column_of_row_j)?first_column_of_row_i:first_column_of_row_j;
+      Real temporary_variable=desparsed_matrix[offset_of_row_i+j]-SkylineDotProduct(&desparsed_matrix[offset_of_row_i+first_common_column], 
+        &desparsed_matrix[offset_of_row_j+first_common_column], j-first_common_column);
+      desparsed_matrix[offset_of_row_i+j]=temporary_variable/desparsed_matrix[accumulative_half_band_width_vector[j]];
+    }
+    Real diagonal=desparsed_matrix[accumulative_half_band_width_vector[i]]-SkylineDotProduct(&desparsed_matrix[offset_of_row_i+first_column_of_row_i], 
+      &desparsed_matrix[offset_of_row_i+first_column_of_row_i], i-first_column_of_row_i);
+    if(!(diagonal>0.0)) return 1;
+    desparsed_matrix[accumulative_half_band_width_vector[i]]=sqrt(diagonal);
+  }
+  return 0;
+}
+
+// solves L*L^T*x=b with the factor from SkylineCholeskyDecomposition, b is overwritten by x
+template<typename Real>
+void Solver::SkylineForwardAndBackwardSubstitution(std::vector<Real>& desparsed_matrix, std::vector<int>& accumulative_half_band_width_vector, std::vector<double>& right_hand_side){
+  int num_of_equations = accumulative_half_band_width_vector.size();
+  for(int i=0; i<num_of_equations; i++){
+    int offset_of_row_i=accumulative_half_band_width_vector[i]-i;
+    int first_column_of_row_i=(i==0)?0:i-(accumulative_half_band_width_vector[i]-accumulative_half_band_width_vector[i-1])+1;
+    double temporary_variable=right_hand_side[i];
+    for(int k=first_column_of_row_i; k<i; k++)
+      temporary_variable -= desparsed_matrix[offset_of_row_i+k]*right_hand_side[k];
+    right_hand_side[i]=temporary_variable/desparsed_matrix[accumulative_half_band_width_vector[i]];
+  }
+  for(int i=num_of_equations-1; i>=0; i--){
+    int offset_of_row_i=accumulative_half_band_width_vector[i]-i;
+    int first_column_of_row_i=(i==0)?0:i-(accumulative_half_band_width_vector[i]-accumulative_half_band_width_vector[i-1])+1;
+    right_hand_side[i] /= desparsed_matrix[accumulative_half_band_width_vector[i]];
+    for(int k=first_column_of_row_i; k<i; k++)
+      right_hand_side[k] -= desparsed_matrix[offset_of_row_i+k]*right_hand_side[i];
+  }
+}
+
+// skyline LU decomposition A=L*U without pivoting for a matrix with a symmetric profile. the lower triangle is stored by rows as
+// in SkylineCholeskyDecomposition and is overwritten by the unit lower factor L; the upper triangle is stored by columns on the
+// same profile, A(i,j) at accumulative_half_band_width_vector[j]-(j-i), and is overwritten by U. the diagonal of U goes to the 
+// diagonal slot of the lower storage. returns 1 if a pivot vanishes.
+template<typename Real>
+int Solver::SkylineLUDecomposition(std::vector<Real>& lower_matrix, std::vector<Real>& upper_matrix, 
+std::vector<int>& accumulative_half_band_width_vector){
+  int num_of_equations = accumulative_half_band_width_vector.size();
+  for(int i=0; i<num_of_equations; i++){
+    int offset_of_i=accumulative_half_band_width_vector[i]-i;
+    int first_column_of_row_i=(i==0)?0:i-(accumulative_half_band_width_vector[i]-accumulative_half_band_width_vector[i-1])+1;
+    for(int j=first_column_of_row_i; j<i; j++){
+      int offset_of_j=accumulative_half_band_width_vector[j]-j;
+      int first_column_of_row_j=(j==0)?0:j-(accumulative_half_band_width_vector[j]-accumulative_half_band_width_vector[j-1])+1;
+      int first_common_column=(first_column_of_row_i>first_column_of_row_j)?first_column_of_row_i:first_column_of_row_j;
+      int length=j-first_common_column;
+      Real lower_entry=lower_matrix[offset_of_i+j]  //L(i,j)
+        -SkylineDotProduct(&lower_matrix[offset_of_i+first_common_column], &upper_matrix[offset_of_j+first_common_column], length);
+      Real upper_entry=upper_matrix[offset_of_i+j]  //U(j,i)
+        -SkylineDotProduct(&lower_matrix[offset_of_j+first_common_column], &upper_matrix[offset_of_i+first_common_column], length);
+      lower_matrix[offset_of_i+j]=lower_entry/lower_matrix[accumulative_half_band_width_vector[j]];
+      upper_matrix[offset_of_i+j]=upper_entry;
+    }
+    Real diagonal=lower_matrix[accumulative_half_band_width_vector[i]]
+      -SkylineDotProduct(&lower_matrix[offset_of_i+first_column_of_row_i], &upper_matrix[offset_of_i+first_column_of_row_i], i-first_column_of_row_i);
+    if(!(fabs(diagonal)>0.0) || diagonal!=diagonal) return 1;
+    lower_matrix[accumulative_half_band_width_vector[i]]=diagonal;
+  }
+  return 0;
+}
+
+// solves L*U*x=b with the factors from SkylineLUDecomposition, b is overwritten by x
+template<typename Real>
+void Solver::SkylineLUForwardAndBackwardSubstitution(std::vector<Real>& lower_matrix, std::vector<Real>& upper_matrix, 
+std::vector<int>& accumulative_half_band_width_vector, std::vector<double>& right_hand_side){
+  int num_of_equations = accumulative_half_band_width_vector.size();
+  for(int i=0; i<num_of_equations; i++){
+    int offset_of_i=accumulative_half_band_width_vector[i]-i;
+    int first_column_of_row_i=(i==0)?0:i-(accumulative_half_band_width_vector[i]-accumulative_half_band_width_vector[i-1])+1;
+    double temporary_variable=right_hand_side[i];
+    for(int k=first_column_of_row_i; k<i; k++)
+      temporary_variable -= lower_matrix[offset_of_i+k]*right_hand_side[k];
+    right_hand_side[i]=temporary_variable;
+  }
+  for(int i=num_of_equations-1; i>=0; i--){
+    int offset_of_i=accumulative_half_band_width_vector[i]-i;
+    int first_column_of_row_i=(i==0)?0:i-(accumulative_half_band_width_vector[i]-accumulative_half_band_width_vector[i-1])+1;
+    right_hand_side[i] /= lower_matrix[accumulative_half_band_width_vector[i]];
+    for(int k=first_column_of_row_i; k<i; k++)
+      right_hand_side[k] -= upper_matrix[offset_of_i+k]*right_hand_side[i];
+  }
+}
+
+// y=A*x over the whole skyline profile. lower holds A(i,j), j<=i, by rows and upper holds A(j,i), j<i, on the same offsets; 
+// for the symmetric tangent both are the same vector
+void Solver::SkylineMatrixVectorProduct(std::vector<double>& lower_matrix, std::vector<double>& upper_matrix, 
+std::vector<int>& accumulative_half_band_width_vector, std::vector<double>& x, std::vector<double>& y){
+  int num_of_equations = accumulative_half_band_width_vector.size();
+  for(int i=0; i<num_of_equations; i++) y[i]=0.0;
+  for(int i=0; i<num_of_equations; i++){
+    int offset_of_row_i=accumulative_half_band_width_vector[i]-i;
+    int first_column_of_row_i=(i==0)?0:i-(accumulative_half_band_width_vector[i]-accumulative_half_band_width_vector[i-1])+1;
+    double row_sum=lower_matrix[accumulative_half_band_width_vector[i]]*x[i];
+    double x_i=x[i];
+    for(int k=first_column_of_row_i; k<i; k++){
+      row_sum += lower_matrix[offset_of_row_i+k]*x[k];
+      y[k] += upper_matrix[offset_of_row_i+k]*x_i;
+    }
+    y[i] += row_sum;
+  }
+}
+
+// factors the assembled jacobian into lower_factor/upper_factor, or into the single precision copy. the diagonal scaling
+// D*J*D with D=|diag J|^-1/2 is applied when equilibration is on. if a pivot fails and shift recovery is on, the factorization
+// is repeated on a copy whose diagonal is raised by kInitialPivotShift_, growing by kPivotShiftGrowth_ per attempt, of its
+// own magnitude; the solve then refines against the unshifted jacobian. returns 1 if every attempt fails
+int Solver::FactorSkylineJacobian(std::vector<double>& jacobian_matrix, std::vector<double>& jacobian_upper_matrix, 
+std::vector<int>& accumulative_half_band_width_vector, std::vector<double>& lower_factor, std::vector<double>& upper_factor){
+  int num_of_equations = accumulative_half_band_width_vector.size();
+  if(Constants::kUseSymmetricEquilibration_){
+    equilibration_scales_.resize(num_of_equations);
+    for(int i=0; i<num_of_equations; i++){
+      double diagonal=fabs(jacobian_matrix[accumulative_half_band_width_vector[i]]);
+      equilibration_scales_[i]=(diagonal>0.0)?1.0/sqrt(diagonal):1.0;
+    }
+  }
+  int num_of_attempts=Constants::kUsePivotShiftRecovery_?1+Constants::kMaxPivotShiftAttempts_:1;
+  double shift=0.0;
+  for(int attempt=0; attempt<num_of_attempts; attempt++){
+    if(attempt==1) shift=Constants::kInitialPivotShift_;
+    else if(attempt>1) shift *= Constants::kPivotShiftGrowth_;
+    int is_singular=Constants::kUseMixedPrecisionFactorization_
+      ? FactorScaledSkylineCopy(jacobian_matrix, jacobian_upper_matrix, accumulative_half_band_width_vector, 
+          single_precision_factor_, single_precision_factor_upper_, shift)
+      : FactorScaledSkylineCopy(jacobian_matrix, jacobian_upper_matrix, accumulative_half_band_width_vector, 
+          lower_factor, upper_factor, shift);
+    if(!is_singular){
+      is_factor_shifted_=(shift>0.0);
+      if(is_factor_shifted_) ++num_of_shifted_factorizations_;
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// copies the jacobian into the factor storage unless they are the same vectors, scales and shifts it, and factors it in place.
+// copy and scaling share one pass over the profile
+template<typename Real>
+int Solver::FactorScaledSkylineCopy(std::vector<double>& jacobian_matrix, std::vector<double>& jacobian_upper_matrix, 
+std::vector<int>& accumulative_half_band_width_vector, std::vector<Real>& lower_factor, std::vector<Real>& upper_factor, 
+const double shift){
+  int num_of_equations = accumulative_half_band_width_vector.size();
+  const bool is_copy=((void*)&lower_factor!=(void*)&jacobian_matrix);
+  const bool has_upper=Constants::kUseConsistentTangent_;
+  if(is_copy){
+    lower_factor.resize(jacobian_matrix.size());
+    if(has_upper) upper_factor.resize(jacobian_upper_matrix.size());
+  }
+  const double* lower_entries=jacobian_matrix.data();
+  const double* upper_entries=jacobian_upper_matrix.data();
+  Real* lower=lower_factor.data();
+  Real* upper=upper_factor.data();
+  if(Constants::kUseSymmetricEquilibration_){
+    const double* scales=equilibration_scales_.data();
+    for(int i=0; i<num_of_equations; i++){
+      int offset_of_row_i=accumulative_half_band_width_vector[i]-i;
+      int first_column_of_row_i=(i==0)?0:i-(accumulative_half_band_width_vector[i]-accumulative_half_band_width_vector[i-1])+1;
+      double scale_of_row_i=scales[i];
+      for(int j=first_column_of_row_i; j<=i; j++){
+        double scale=scale_of_row_i*scales[j];
+        lower[offset_of_row_i+j]=lower_entries[offset_of_row_i+j]*scale;
+        if(has_upper) upper[offset_of_row_i+j]=upper_entries[offset_of_row_i+j]*scale;
+      }
+    }
+  }
+  else if(is_copy){
+    std::copy(jacobian_matrix.begin(), jacobian_matrix.end(), lower_factor.begin());
+    if(has_upper) std::copy(jacobian_upper_matrix.begin(), jacobian_upper_matrix.end(), upper_factor.begin());
+  }
+  if(shift>0.0){
+    for(int i=0; i<num_of_equations; i++){
+      Real& diagonal=lower_factor[accumulative_half_band_width_vector[i]];
+      diagonal += shift*((diagonal!=0.0)?fabs(diagonal):1.0);
+    }
+  }
+  if(Constants::kUseConsistentTangent_)
+    return SkylineLUDecomposition(lower_factor, upper_factor, accumulative_half_band_width_vector);
+  return SkylineCholeskyDecomposition(lower_factor, accumulative_half_band_width_vector);
+}
+
+// r is overwritten by M^-1*r for the stored skyline factor M, the single precision copy or the double one, inside the 
+// equilibration scaling when that is on
+void Solver::ApplySkylineFactor(std::vector<double>& lower_factor, std::vector<double>& upper_factor, 
+std::vector<int>& accumulative_half_band_width_vector, std::vector<double>& r){
+  int num_of_equations = r.size();
+  if(Constants::kUseSymmetricEquilibration_)
+    for(int i=0; i<num_of_equations; i++) r[i] *= equilibration_scales_[i];
+  if(Constants::kUseMixedPrecisionFactorization_){
+    if(Constants::kUseConsistentTangent_)
+      SkylineLUForwardAndBackwardSubstitution(single_precision_factor_, single_precision_factor_upper_, accumulative_half_band_width_vector, r);
+    else
+      SkylineForwardAndBackwardSubstitution(single_precision_factor_, accumulative_half_band_width_vector, r);
+  }
+  else if(Constants::kUseConsistentTangent_)
+    SkylineLUForwardAndBackwardSubstitution(lower_factor, upper_factor, accumulative_half_band_width_vector, r);
+  else
+    SkylineForwardAndBackwardSubstitution(lower_factor, accumulative_half_band_width_vector, r);
+  if(Constants::kUseSymmetricEquilibration_)
+    for(int i=0; i<num_of_equations; i++) r[i] *= equilibration_scales_[i];
+}
+
+// solves the newton system with a single precision or shifted factor, then refines the correction against the double precision
+// jacobian until the linear residual drops below kRefinementRelativeTolerance_ of the right hand side. the right hand side
+// is overwritten by the solution
+void Solver::RefinedSkylineSolve(std::vector<double>& lower_matrix, std::vector<double>& upper_matrix, 
+std::vector<int>& accumulative_half_band_width_vector, std::vector<double>& lower_factor, std::vector<double>& upper_factor, 
+std::vector<double>& right_hand_side){
+  int num_of_equations = right_hand_side.size();
+  residual_=right_hand_side;
+  double norm_of_right_hand_side=NormOfVector(right_hand_side);
+  for(int i=0; i<num_of_equations; i++) iterate_[i]=0.0;
+  double norm_of_last_residual=-1.0;
+  for(int step=0; step<=Constants::kMaxRefinementSteps_; step++){
+    ApplySkylineFactor(lower_factor, upper_factor, accumulative_half_band_width_vector, residual_);
+    for(int i=0; i<num_of_equations; i++) iterate_[i] += residual_[i];
+    if(step>0) ++num_of_refinement_steps_;
+//   r=b-A*x in double precision
+    SkylineMatrixVectorProduct(lower_matrix, Constants::kUseConsistentTangent_?upper_matrix:lower_matrix, 
+      accumulative_half_band_width_vector, iterate_, matrix_times_search_direction_);
+    for(int i=0; i<num_of_equations; i++) residual_[i]=right_hand_side[i]-matrix_times_search_direction_[i];
+    double norm_of_residual=NormOfVector(residual_);
+//   refinement stops once the residual is small, or when it stops contracting and newton has to take over
+    if(norm_of_residual<=Constants::kRefinementRelativeTolerance_*norm_of_right_hand_side) break;
+    if(norm_of_last_residual>=0.0 && norm_of_residual>0.5*norm_of_last_residual) break;
+    norm_of_last_residual=norm_of_residual;
+  }
+  for(int i=0; i<num_of_equations; i++) right_hand_side[i]=iterate_[i];
+}
+
+// y=A*x for the symmetric matrix whose lower triangle sits in the skyline storage, visiting only the element couplings
+void Solver::SparseSymmetricMatrixVectorProduct(std::vector<double>& desparsed_matrix, std::vector<double>& x, std::vector<double>& y){
+  int num_of_equations=x.size();
+  for(int i=0; i<num_of_equations; i++) y[i]=0.0;
+  for(int i=0; i<num_of_equations; i++){
+    double row_sum=0.0;
+    double x_i=x[i];
+    for(int k=pattern_row_starts_[i]; k<pattern_row_starts_[i+1]-1; k++){
+      double entry=desparsed_matrix[pattern_offsets_[k]];
+      row_sum += entry*x[pattern_columns_[k]];
+      y[pattern_columns_[k]] += entry*x_i;
+    }
+    y[i] += row_sum+desparsed_matrix[pattern_offsets_[pattern_row_starts_[i+1]-1]]*x_i;
+  }
+}
+
+// incomplete cholesky with no fill outside the element couplings, diagonal shifted by (1+shift). returns 1 on a non-positive pivot
+int Solver::IncompleteCholeskyDecomposition(std::vector<double>& desparsed_matrix, const double shift){
+  int num_of_equations=pattern_row_starts_.size()-1;
+  for(int i=0; i<num_of_equations; i++){
+    int diagonal_position=pattern_row_starts_[i+1]-1;
+    for(int k=pattern_row_starts_[i]; k<diagonal_position; k++){
+      int j=pattern_columns_[k];
+      double temporary_variable=desparsed_matrix[pattern_offsets_[k]];
+      //sparse dot product of rows i and j over columns below j
+      int position_in_i=pattern_row_starts_[i];
+      int position_in_j=pattern_row_starts_[j];
+      while(position_in_i<k && position_in_j<pattern_row_starts_[j+1]-1){
+        if(pattern_columns_[position_in_i]<pattern_columns_[position_in_j]) position_in_i++;
+        else if(pattern_columns_[position_in_i]>pattern_columns_[position_in_j]) position_in_j++;
+        else temporary_variable -= preconditioner_values_[position_in_i++]*preconditioner_values_[position_in_j++];
+      }
+      preconditioner_values_[k]=temporary_variable/preconditioner_values_[pattern_row_starts_[j+1]-1];
+    }
+    double diagonal=desparsed_matrix[pattern_offsets_[diagonal_position]]*(1.0+shift);
+    for(int k=pattern_row_starts_[i]; k<diagonal_position; k++)
+      diagonal -= preconditioner_values_[k]*preconditioner_values_[k];
+    if(!(diagonal>0.0)) return 1;
+    preconditioner_values_[diagonal_position]=sqrt(diagonal);
+  }
+  return 0;
+}
+
+// z=M^-1*r with the jacobi diagonal or the incomplete cholesky factor held in preconditioner_values_, or one multigrid v-cycle
+void Solver::ApplyPreconditioner(std::vector<double>& r, std::vector<double>& z){
+  int num_of_equations=r.size();
+  if(Constants::kPcgPreconditioner_==2 || Constants::kLinearSolverBackend_==2){
+    (*geometric_multigrid_).ApplyVCycle(r, z);
+    return;
+  }
+  if(Constants::kPcgPreconditioner_==0){
+    for(int i=0; i<num_of_equations; i++) z[i]=r[i]*preconditioner_values_[pattern_row_starts_[i+1]-1];
+    return;
+  }
+  for(int i=0; i<num_of_equations; i++){
+    double temporary_variable=r[i];
+    for(int k=pattern_row_starts_[i]; k<pattern_row_starts_[i+1]-1; k++)
+      temporary_variable -= preconditioner_values_[k]*z[pattern_columns_[k]];
+    z[i]=temporary_variable/preconditioner_values_[pattern_row_starts_[i+1]-1];
+  }
+  for(int i=num_of_equations-1; i>=0; i--){
+    z[i] /= preconditioner_values_[pattern_row_starts_[i+1]-1];
+    for(int k=pattern_row_starts_[i]; k<pattern_row_starts_[i+1]-1; k++)
+      z[pattern_columns_[k]] -= preconditioner_values_[k]*z[i];
+  }
+}
+
+// solves A*x=b for the symmetric positive definite matrix in the skyline storage, starting from initial_guess unless that 
+// leaves a larger residual than x=0. b is overwritten by x. returns 1 if the matrix is not positive definite or the 
+// iteration does not reach kPcgRelativeTolerance_
+int Solver::PreconditionedConjugateGradient(std::vector<double>& desparsed_matrix, std::vector<int>& accumulative_half_band_width_vector, 
+std::vector<double>& right_hand_side, std::vector<double>& initial_guess){
+  int num_of_equations=right_hand_side.size();
+
+  if(Constants::kPcgPreconditioner_==0){
+    for(int i=0; i<num_of_equations; i++){
+      double diagonal=desparsed_matrix[accumulative_half_band_width_vector[i]];
+      if(!(diagonal>0.0)) return 1;
+      preconditioner_values_[pattern_row_starts_[i+1]-1]=1.0/diagonal;
+    }
+  }
+  else if(Constants::kPcgPreconditioner_==2){
+    if((*geometric_multigrid_).BuildLevelOperators(desparsed_matrix, accumulative_half_band_width_vector)) return 1;
+  }
+  else{
+    double shift=0.0;
+    while(IncompleteCholeskyDecomposition(desparsed_matrix, shift)){
+      shift=(shift==0.0)?1.0e-3:2.0*shift;
+      if(shift>1.0) return 1;
+    }
+  }
+
+  double right_hand_side_norm=NormOfVector(right_hand_side);
+  SparseSymmetricMatrixVectorProduct(desparsed_matrix, initial_guess, matrix_times_search_direction_);
+  for(int i=0; i<num_of_equations; i++){
+    iterate_[i]=initial_guess[i];
+    residual_[i]=right_hand_side[i]-matrix_times_search_direction_[i];
+  }
+  if(NormOfVector(residual_)>right_hand_side_norm){
+    for(int i=0; i<num_of_equations; i++){
+      iterate_[i]=0.0;
+      residual_[i]=right_hand_side[i];
+    }
+  }
+
+  ++num_of_krylov_solves_;
+  ApplyPreconditioner(residual_, preconditioned_residual_);
+  double residual_dot_preconditioned=0.0;
+  for(int i=0; i<num_of_equations; i++){
+    search_direction_[i]=preconditioned_residual_[i];
+    residual_dot_preconditioned += residual_[i]*preconditioned_residual_[i];
+  }
+  bool is_converged=NormOfVector(residual_)<=Constants::kPcgRelativeTolerance_*right_hand_side_norm;
+  for(int iteration=0; iteration<Constants::kMaxPcgIterations_ && !is_converged; iteration++){
+    ++num_of_krylov_iterations_;
+    SparseSymmetricMatrixVectorProduct(desparsed_matrix, search_direction_, matrix_times_search_direction_);
+    double curvature=0.0;
+    for(int i=0; i<num_of_equations; i++) curvature += search_direction_[i]*matrix_times_search_direction_[i];
+    if(!(curvature>0.0)) return 1;
+    double step_length=residual_dot_preconditioned/curvature;
+    double residual_norm_square=0.0;
+    for(int i=0; i<num_of_equations; i++){
+      iterate_[i] += step_length*search_direction_[i];
+      residual_[i] -= step_length*matrix_times_search_direction_[i];
+      residual_norm_square += residual_[i]*residual_[i];
+    }
+    if(sqrt(residual_norm_square)<=Constants::kPcgRelativeTolerance_*right_hand_side_norm){
+      is_converged=true;
+      break;
+    }
+    ApplyPreconditioner(residual_, preconditioned_residual_);
+    double new_residual_dot_preconditioned=0.0;
+    for(int i=0; i<num_of_equations; i++) new_residual_dot_preconditioned += residual_[i]*preconditioned_residual_[i];
+    double direction_update=new_residual_dot_preconditioned/residual_dot_preconditioned;
+    residual_dot_preconditioned=new_residual_dot_preconditioned;
+    for(int i=0; i<num_of_equations; i++) 
+      search_direction_[i]=preconditioned_residual_[i]+direction_update*search_direction_[i];
+  }
+  if(!is_converged) return 1;
+  for(int i=0; i<num_of_equations; i++) right_hand_side[i]=iterate_[i];
+  return 0;
+}
+
+// J*v from two residuals, J*v=(F(T)-F(T+eps*v))/eps since right_hand_side_function holds -F. eps scales a relative 
+// perturbation of 1e-5 of the typical temperature by the root mean square of v. the temperature field and the residual 
+// are restored afterwards.
+void Solver::FiniteDifferenceJacobianProduct(GlobalVectorsAndMatrices *global_vectors_and_matrices, const double time_increment, 
+std::vector<double>& v, std::vector<double>& jacobian_times_v){
+  std::vector<double>& current_temperature_field=(*global_vectors_and_matrices).get_current_temperature_field();
+  std::vector<double>& right_hand_side_function=(*global_vectors_and_matrices).get_right_hand_side_function();
+  std::vector<int>& equation_numbers_of_nodes=*equation_numbers_of_nodes_;
+  int num_of_equations=v.size();
+  int num_of_nodes=current_temperature_field.size();
+  double v_norm=NormOfVector(v);
+  if(v_norm==0.0){
+    std::fill(jacobian_times_v.begin(), jacobian_times_v.end(), 0.0);
+    return;
+  }
+  double typical_temperature=NormOfVector(current_temperature_field)/sqrt((double)num_of_nodes);
+  double perturbation=1.0e-5*(1.0+typical_temperature)*sqrt((double)num_of_equations)/v_norm;
+
+  unperturbed_temperature_field_=current_temperature_field;
+  for(int i=0; i<num_of_nodes; i++){
+    int equation_number=equation_numbers_of_nodes[i];
+    if(equation_number>=0) current_temperature_field[i] += perturbation*v[equation_number];
+  }
+  (*parallel_assembly_).AssembleFusedResidual(global_vectors_and_matrices, time_increment);
+  for(int i=0; i<num_of_equations; i++)
+    jacobian_times_v[i]=(base_residual_[i]-right_hand_side_function[i])/perturbation;
+  current_temperature_field.swap(unperturbed_temperature_field_);
+  right_hand_side_function=base_residual_;
+}
+
+// newton step J*x=b with b the residual in right_hand_side_function, by restarted gmres on finite difference products, right
+// preconditioned by a multigrid v-cycle of a lagged symmetric tangent. the tangent is assembled into stencils only when the
+// time increment changes or the last solve needed more than kJfnkPreconditionerRefreshIterations_ iterations. x overwrites b. 
+// returns 1 if the preconditioner cannot be built or gmres stalls.
+int Solver::JacobianFreeNewtonKrylov(GlobalVectorsAndMatrices *global_vectors_and_matrices, const double time_increment){
+  std::vector<double>& right_hand_side_function=(*global_vectors_and_matrices).get_right_hand_side_function();
+  int num_of_equations=right_hand_side_function.size();
+  int restart=Constants::kGmresRestart_;
+
+  if(!is_factorization_valid_ || time_increment!=factorized_time_increment_ 
+     || num_of_krylov_iterations_of_last_solve_>Constants::kJfnkPreconditionerRefreshIterations_){
+    is_factorization_valid_=false;
+    (*global_vectors_and_matrices).ZeroVectorAndMatrix();
+    (*parallel_assembly_).AssembleFusedJacobianAndResidual(global_vectors_and_matrices, time_increment);
+    if((*geometric_multigrid_).BuildLevelOperatorsFromStencils((*global_vectors_and_matrices).get_jacobian_matrix_global())) return 1;
+    is_factorization_valid_=true;
+    factorized_time_increment_=time_increment;
+    ++num_of_factorizations_;
+  }
+  base_residual_=right_hand_side_function;
+
+  ++num_of_krylov_solves_;
+  std::fill(iterate_.begin(), iterate_.end(), 0.0);
+  residual_=base_residual_;
+  double target_residual_norm=Constants::kJfnkRelativeTolerance_*NormOfVector(base_residual_);
+  int num_of_iterations=0;
+  bool is_converged=false;
+  while(true){
+    double residual_norm=NormOfVector(residual_);
+    if(residual_norm<=target_residual_norm){
+      is_converged=true;
+      break;
+    }
+    if(num_of_iterations>=Constants::kMaxGmresIterations_) break;
+
+    for(int i=0; i<num_of_equations; i++) krylov_basis_[0][i]=residual_[i]/residual_norm;
+    std::fill(least_squares_right_hand_side_.begin(), least_squares_right_hand_side_.end(), 0.0);
+    least_squares_right_hand_side_[0]=residual_norm;
+    int num_of_basis_vectors=0;
+    while(num_of_basis_vectors<restart && num_of_iterations<Constants::kMaxGmresIterations_){
+      int k=num_of_basis_vectors;
+      double* hessenberg_column=&hessenberg_matrix_[k*(restart+1)];
+      ApplyPreconditioner(krylov_basis_[k], preconditioned_residual_);
+      FiniteDifferenceJacobianProduct(global_vectors_and_matrices, time_increment, preconditioned_residual_, krylov_basis_[k+1]);
+      std::vector<double>& w=krylov_basis_[k+1];
+      for(int l=0; l<=k; l++){ //modified gram-schmidt
+        double projection=0.0;
+        for(int i=0; i<num_of_equations; i++) projection += w[i]*krylov_basis_[l][i];
+        for(int i=0; i<num_of_equations; i++) w[i] -= projection*krylov_basis_[l][i];
+        hessenberg_column[l]=projection;
+      }
+      double w_norm=NormOfVector(w);
+      hessenberg_column[k+1]=w_norm;
+      if(w_norm>0.0)
+        for(int i=0; i<num_of_equations; i++) w[i] /= w_norm;
+      for(int l=0; l<k; l++){
+        double temporary_variable=givens_cosines_[l]*hessenberg_column[l]+givens_sines_[l]*hessenberg_column[l+1];
+        hessenberg_column[l+1]=-givens_sines_[l]*hessenberg_column[l]+givens_cosines_[l]*hessenberg_column[l+1];
+        hessenberg_column[l]=temporary_variable;
+      }
+      double hypotenuse=sqrt(hessenberg_column[k]*hessenberg_column[k]+hessenberg_column[k+1]*hessenberg_column[k+1]);
+      givens_cosines_[k]=hessenberg_column[k]/hypotenuse;
+      givens_sines_[k]=hessenberg_column[k+1]/hypotenuse;
+      hessenberg_column[k]=hypotenuse;
+      hessenberg_column[k+1]=0.0;
+      least_squares_right_hand_side_[k+1]=-givens_sines_[k]*least_squares_right_hand_side_[k];
+      least_squares_right_hand_side_[k] *= givens_cosines_[k];
+      ++num_of_basis_vectors;
+      ++num_of_iterations;
+      if(fabs(least_squares_right_hand_side_[k+1])<=target_residual_norm || w_norm==0.0) break;
+    }
+
+    //x += M^-1 * V*y with y from the triangular least squares system
+    for(int k=num_of_basis_vectors-1; k>=0; k--){
+      double temporary_variable=least_squares_right_hand_side_[k];
+      for(int l=k+1; l<num_of_basis_vectors; l++) 
+        temporary_variable -= hessenberg_matrix_[l*(restart+1)+k]*least_squares_right_hand_side_[l];
+      least_squares_right_hand_side_[k]=temporary_variable/hessenberg_matrix_[k*(restart+1)+k];
+    }
+    std::fill(residual_.begin(), residual_.end(), 0.0);
+    for(int k=0; k<num_of_basis_vectors; k++)
+      for(int i=0; i<num_of_equations; i++) residual_[i] += least_squares_right_hand_side_[k]*krylov_basis_[k][i];
+    ApplyPreconditioner(residual_, preconditioned_residual_);
+    for(int i=0; i<num_of_equations; i++) iterate_[i] += preconditioned_residual_[i];
+
+    //true residual for the restart and the convergence test
+    FiniteDifferenceJacobianProduct(global_vectors_and_matrices, time_increment, iterate_, matrix_times_search_direction_);
+    for(int i=0; i<num_of_equations; i++) residual_[i]=base_residual_[i]-matrix_times_search_direction_[i];
+  }
+  num_of_krylov_iterations_+=num_of_iterations;
+  num_of_krylov_iterations_of_last_solve_=num_of_iterations;
+  if(!is_converged) return 1;
+  for(int i=0; i<num_of_equations; i++) right_hand_side_function[i]=iterate_[i];
+  return 0;
+}
+
 
 class OutputResults{
 public:
@@ -2077,6 +4843,324 @@ void OutputResults::OutputCopperSurfaceTemperature(const int time_step, const do
 }
 
 
+// wall time of each model setup stage, printed once before the first time step
+class SetupTimeReport{
+public:
+  void InitializeSetupTimeReport(){
+    stage_names_.clear();
+    stage_seconds_.clear();
+    last_mark_=std::chrono::steady_clock::now();
+  }
+  void RecordStage(const char* stage_name){
+    std::chrono::steady_clock::time_point now=std::chrono::steady_clock::now();
+    stage_names_.push_back(stage_name);
+    stage_seconds_.push_back(std::chrono::duration<double>(now-last_mark_).count());
+    last_mark_=now;
+  }
+  void PrintSetupTimeReport(){
+    double total_seconds=0.0;
+    printf("model setup time\n");
+    for(int i=0;i<(int)stage_names_.size();i++){
+      printf("  %-32s %10.4f s\n", stage_names_[i].c_str(), stage_seconds_[i]);
+      total_seconds+=stage_seconds_[i];
+    }
+    printf("  %-32s %10.4f s\n\n", "total", total_seconds);
+  }
+
+private:
+  std::chrono::steady_clock::time_point last_mark_;
+  std::vector<std::string> stage_names_;
+  std::vector<double> stage_seconds_;
+};
+
+
+// bilinear interpolation between two row-major fields on tensor-product grids, given by their column x and row y coordinates.
+// targets outside the source grid take the nearest edge value
+class TensorProductInterpolation{
+public:
+  void InitializeTensorProductInterpolation(std::vector<double>& source_columns, std::vector<double>& source_rows, 
+    std::vector<double>& target_columns, std::vector<double>& target_rows){
+    num_of_source_columns_=source_columns.size();
+    BracketCoordinates(source_columns, target_columns, left_columns_, right_weights_);
+    BracketCoordinates(source_rows, target_rows, lower_rows_, upper_weights_);
+  }
+  void Interpolate(std::vector<double>& source_field, std::vector<double>& target_field){
+    int num_of_target_columns=left_columns_.size();
+    for(int j=0;j<(int)lower_rows_.size();j++){
+      const double* lower_row=&source_field[lower_rows_[j]*num_of_source_columns_];
+      const double* upper_row=lower_row+num_of_source_columns_;
+      double upper_weight=upper_weights_[j];
+      for(int i=0;i<num_of_target_columns;i++){
+        int left=left_columns_[i];
+        double right_weight=right_weights_[i];
+        double lower_value=(1.0-right_weight)*lower_row[left]+right_weight*lower_row[left+1];
+        double upper_value=(1.0-right_weight)*upper_row[left]+right_weight*upper_row[left+1];
+        target_field[j*num_of_target_columns+i]=(1.0-upper_weight)*lower_value+upper_weight*upper_value;
+      }
+    }
+  }
+
+private:
+  //source interval [lower, lower+1] of every target coordinate and the weight of its upper end
+  static void BracketCoordinates(std::vector<double>& source, std::vector<double>& target, std::vector<int>& lower, 
+    std::vector<double>& upper_weights){
+    lower.resize(target.size());
+    upper_weights.resize(target.size());
+    for(int i=0;i<(int)target.size();i++){
+      int k=std::upper_bound(source.begin(), source.end(), target[i])-source.begin()-1;
+      k=std::max(0, std::min(k, (int)source.size()-2));
+      lower[i]=k;
+      upper_weights[i]=std::max(0.0, std::min(1.0, (target[i]-source[k])/(source[k+1]-source[k])));
+    }
+  }
+  int num_of_source_columns_;
+  std::vector<int> left_columns_;
+  std::vector<double> right_weights_;
+  std::vector<int> lower_rows_;
+  std::vector<double> upper_weights_;
+};
+
+
+// the model on a mesh with the in-plane seeds divided by kNestedIterationCoarseningFactor_. it solves the fine time step first;
+// its temperature change from the restricted starting field, interpolated back, corrects the fine newton starting field.
+class NestedIterationModel{
+public:
+  void InitializeNestedIterationModel(Initialization *const, GenerateMesh *const, TemperatureDependentVariables *const);
+  void CorrectPredictedTemperatureField(std::vector<double>&, std::vector<double>&, double);
+  int get_num_of_equations()
+    {return dof_and_equation_numbers_.get_num_of_equations();}
+  void PrintNestedIterationStatistics() const
+    {printf("nested iteration: %d coarse time steps, %d coarse newton iterations, %d coarse steps failed\n", num_of_coarse_steps_, 
+       num_of_coarse_iterations_, num_of_failed_coarse_steps_);}
+
+private:
+  int SolveTimeStep(double);
+  Initialization* fine_initialization_;
+  Initialization initialization_;
+  GenerateMesh generate_mesh_;
+  DegreeOfFreedomAndEquationNumbers dof_and_equation_numbers_;
+  HalfBandWidth half_band_width_;
+  ElementScatterMap element_scatter_map_;
+  BoundaryCondition boundary_condition_;
+  HeaterElements heater_elements_;
+  RadiationElements radiation_elements_;
+  MaterialParameters material_parameters_;
+  GlobalVectorsAndMatrices global_vectors_and_matrices_;
+  ElementGeometryCache geometry_cache_three_by_three_;
+  ElementGeometryCache geometry_cache_two_by_two_;
+  ElementTensorIntegrals element_tensor_integrals_;
+  ParallelAssembly parallel_assembly_;
+  GeometricMultigrid geometric_multigrid_;
+  Solver solver_;
+  Assemble assemble_;
+  TensorProductInterpolation restriction_;   //fine to coarse
+  TensorProductInterpolation prolongation_;  //coarse to fine
+  std::vector<double> restricted_predicted_field_;
+  std::vector<double> coarse_temperature_change_;
+  std::vector<double> fine_temperature_correction_;
+  int num_of_coarse_steps_;
+  int num_of_coarse_iterations_;
+  int num_of_failed_coarse_steps_;
+};
+void NestedIterationModel::InitializeNestedIterationModel(Initialization *const fine_initialization, GenerateMesh *const fine_generate_mesh, 
+TemperatureDependentVariables *const temperature_dependent_variables){
+  fine_initialization_=fine_initialization;
+  initialization_=*fine_initialization;
+  MeshParameters& mesh_parameters=*(initialization_.get_mesh_parameters());
+  int factor=Constants::kNestedIterationCoarseningFactor_;
+  mesh_parameters.set_mesh_seeds_on_end(std::max(1, mesh_parameters.get_mesh_seeds_on_end()/factor));
+  mesh_parameters.set_mesh_seeds_on_heater(std::max(1, mesh_parameters.get_mesh_seeds_on_heater()/factor));
+  mesh_parameters.set_mesh_seeds_on_gap(std::max(2, mesh_parameters.get_mesh_seeds_on_gap()/factor/2*2)); //gap seeds stay even
+  mesh_parameters.set_dimensions_of_x();
+  mesh_parameters.set_dimensions_of_y();
+  mesh_parameters.set_num_of_nodes();
+  mesh_parameters.set_num_of_elements();
+  int num_of_nodes=mesh_parameters.get_num_of_nodes();
+  int num_of_elements=mesh_parameters.get_num_of_elements();
+
+  generate_mesh_.GenerateMeshInitializeMeshSizeInfo(&initialization_);
+  generate_mesh_.CalculateCoordinates(&initialization_);
+  std::vector<double>& x_coordinates=generate_mesh_.get_x_coordinates();
+  std::vector<double>& y_coordinates=generate_mesh_.get_y_coordinates();
+  dof_and_equation_numbers_.InitializeDegreeOfFreedomAndEquationNumbers(&initialization_);
+  dof_and_equation_numbers_.set_essential_bc_nodes(&initialization_, y_coordinates);
+  dof_and_equation_numbers_.GenerateNodeAndEquationNumbersInElements(&initialization_);
+  half_band_width_.set_accumulative_half_band_width_vector(&initialization_, &dof_and_equation_numbers_);
+  std::vector<int>& accumulative_half_band_width_vector=half_band_width_.get_accumulative_half_band_width_vector();
+  if(Constants::kLinearSolverBackend_==2)
+    element_scatter_map_.InitializeStencilScatterMap(&initialization_, &dof_and_equation_numbers_);
+  else
+    element_scatter_map_.InitializeElementScatterMap(&initialization_, &dof_and_equation_numbers_, &half_band_width_);
+  boundary_condition_.InitializeBoundaryCondition(&initialization_);
+  heater_elements_.InitializeHeaterElements(&initialization_);
+  heater_elements_.set_elements_as_heater(&initialization_);
+  radiation_elements_.InitializeRadiationElements(&initialization_);
+  radiation_elements_.set_elements_with_radiation(&initialization_);
+  material_parameters_.set_densities();
+  material_parameters_.set_material_id_of_elements(&initialization_);
+  global_vectors_and_matrices_.InitializeGlobalVectorsAndMatrices(num_of_nodes, accumulative_half_band_width_vector);
+
+  std::vector<int>& nodes_in_elements=dof_and_equation_numbers_.get_nodes_in_elements();
+  geometry_cache_three_by_three_.InitializeElementGeometryCache(3, GaussLegendreRule<3>::kCoordinates_.data(), 
+    GaussLegendreRule<3>::kWeights_.data(), num_of_elements, nodes_in_elements, x_coordinates, y_coordinates);
+  geometry_cache_two_by_two_.InitializeElementGeometryCache(2, GaussLegendreRule<2>::kCoordinates_.data(), 
+    GaussLegendreRule<2>::kWeights_.data(), num_of_elements, nodes_in_elements, x_coordinates, y_coordinates);
+  if(Constants::kUseTensorIntegralAssembly_ && (!Constants::kUseFusedAssembly_ || !Constants::kUseBatchedSimdKernels_))
+    element_tensor_integrals_.InitializeElementTensorIntegrals(num_of_elements, &geometry_cache_three_by_three_);
+  parallel_assembly_.InitializeParallelAssembly(&initialization_, &generate_mesh_, &dof_and_equation_numbers_, &element_scatter_map_, 
+    &boundary_condition_, &heater_elements_, &radiation_elements_, &material_parameters_, temperature_dependent_variables, 
+    &geometry_cache_three_by_three_, &geometry_cache_two_by_two_, &element_tensor_integrals_);
+  if((Constants::kLinearSolverBackend_==1 && Constants::kPcgPreconditioner_==2) || Constants::kLinearSolverBackend_==2)
+    geometric_multigrid_.InitializeGeometricMultigrid(&initialization_, &generate_mesh_, &dof_and_equation_numbers_);
+  solver_.InitializeSolver(&dof_and_equation_numbers_, accumulative_half_band_width_vector, &geometric_multigrid_, &parallel_assembly_);
+
+  //both meshes are tensor products, so the column x and row y coordinates define the interpolations
+  int fine_dimensions_of_x=(*((*fine_initialization).get_mesh_parameters())).get_dimensions_of_x();
+  int fine_dimensions_of_y=(*((*fine_initialization).get_mesh_parameters())).get_dimensions_of_y();
+  int dimensions_of_x=mesh_parameters.get_dimensions_of_x();
+  int dimensions_of_y=mesh_parameters.get_dimensions_of_y();
+  std::vector<double>& fine_x_coordinates=(*fine_generate_mesh).get_x_coordinates();
+  std::vector<double>& fine_y_coordinates=(*fine_generate_mesh).get_y_coordinates();
+  std::vector<double> fine_columns(fine_x_coordinates.begin(), fine_x_coordinates.begin()+fine_dimensions_of_x);
+  std::vector<double> fine_rows(fine_dimensions_of_y);
+  for(int j=0;j<fine_dimensions_of_y;j++) fine_rows[j]=fine_y_coordinates[j*fine_dimensions_of_x];
+  std::vector<double> columns(x_coordinates.begin(), x_coordinates.begin()+dimensions_of_x);
+  std::vector<double> rows(dimensions_of_y);
+  for(int j=0;j<dimensions_of_y;j++) rows[j]=y_coordinates[j*dimensions_of_x];
+  restriction_.InitializeTensorProductInterpolation(fine_columns, fine_rows, columns, rows);
+  prolongation_.InitializeTensorProductInterpolation(columns, rows, fine_columns, fine_rows);
+
+  restricted_predicted_field_.assign(num_of_nodes, 0.0);
+  coarse_temperature_change_.assign(num_of_nodes, 0.0);
+  fine_temperature_correction_.assign(fine_x_coordinates.size(), 0.0);
+  num_of_coarse_steps_=0;
+  num_of_coarse_iterations_=0;
+  num_of_failed_coarse_steps_=0;
+}
+
+// full newton on the coarse mesh from the current coarse field, returns 1 if it fails to converge
+int NestedIterationModel::SolveTimeStep(const double time_increment){
+  std::vector<double>& current_temperature_field=global_vectors_and_matrices_.get_current_temperature_field();
+  std::vector<double>& right_hand_side_function=global_vectors_and_matrices_.get_right_hand_side_function();
+  std::vector<double>& solution_of_last_iteration=global_vectors_and_matrices_.get_solution_of_last_iteration();
+  std::vector<int>& equation_numbers_of_nodes=dof_and_equation_numbers_.get_equation_numbers_of_nodes();
+  solver_.ResetContractionHistory();
+  for(int iteration_number=0; ; iteration_number++){
+    if(Constants::kLinearSolverBackend_==2){
+      parallel_assembly_.AssembleFusedResidual(&global_vectors_and_matrices_, time_increment);
+    }
+    else if(Constants::kUseFusedAssembly_){
+      global_vectors_and_matrices_.ZeroVectorAndMatrix();
+      parallel_assembly_.AssembleFusedJacobianAndResidual(&global_vectors_and_matrices_, time_increment);
+    }
+    else{
+      global_vectors_and_matrices_.ZeroVectorAndMatrix();
+      parallel_assembly_.AssembleElementContributions(&global_vectors_and_matrices_, time_increment);
+      assemble_.AssembleGlobalJacobian(&global_vectors_and_matrices_);
+      assemble_.AssembleGlobalYfunction(equation_numbers_of_nodes, &global_vectors_and_matrices_);
+    }
+    if(iteration_number>0 && solver_.NormOfVector(solution_of_last_iteration)<Constants::kNormTolerance_ && 
+       solver_.NormOfVector(right_hand_side_function)<Constants::kYFunctionTolerance_){
+      num_of_coarse_iterations_+=iteration_number;
+      return 0;
+    }
+    if(iteration_number==Constants::kMaxNewtonIteration_) return 1;
+    if(solver_.LinearEquationsSolver(&global_vectors_and_matrices_, time_increment)==1) return 1;
+    for(int j=0; j<(int)current_temperature_field.size(); j++){
+      int equation_count=equation_numbers_of_nodes[j];
+      if(equation_count>=0)
+        current_temperature_field[j] += solution_of_last_iteration[equation_count];
+    }
+  }
+}
+
+// the coarse step runs from the restricted fine fields; a coarse step that fails leaves the fine starting field unchanged
+void NestedIterationModel::CorrectPredictedTemperatureField(std::vector<double>& fine_initial_temperature_field, 
+std::vector<double>& fine_predicted_temperature_field, const double time_increment){
+  std::vector<double>& initial_temperature_field=global_vectors_and_matrices_.get_initial_temperature_field();
+  std::vector<double>& current_temperature_field=global_vectors_and_matrices_.get_current_temperature_field();
+  (*(initialization_.get_currents_in_heater())).get_current_in_heater()=
+    (*((*fine_initialization_).get_currents_in_heater())).get_current_in_heater();
+  restriction_.Interpolate(fine_initial_temperature_field, initial_temperature_field);
+  restriction_.Interpolate(fine_predicted_temperature_field, restricted_predicted_field_);
+  current_temperature_field=restricted_predicted_field_;
+  ++num_of_coarse_steps_;
+  if(SolveTimeStep(time_increment)==1){
+    ++num_of_failed_coarse_steps_;
+    return;
+  }
+  for(int i=0;i<(int)current_temperature_field.size();i++)
+    coarse_temperature_change_[i]=current_temperature_field[i]-restricted_predicted_field_[i];
+  prolongation_.Interpolate(coarse_temperature_change_, fine_temperature_correction_);
+  for(int i=0;i<(int)fine_predicted_temperature_field.size();i++)
+    fine_predicted_temperature_field[i]+=fine_temperature_correction_[i];
+}
+
+
+//extrapolates the starting field of a time step from the last converged fields, which are kept with their times.
+//with a nested iteration model attached, the extrapolation is then corrected by the coarse mesh solution of the step
+class TemperaturePredictor{
+public:
+  void InitializeTemperaturePredictor(int num_of_nodes){
+    for(int k=0;k<3;k++) history_fields_[k].assign(num_of_nodes, 0.0);
+    num_of_history_fields_=0;
+    nested_iteration_model_=NULL;
+  }
+  void set_nested_iteration_model(NestedIterationModel *const nested_iteration_model)
+    {nested_iteration_model_=nested_iteration_model;}
+  void ResetTemperaturePredictor(){
+    num_of_history_fields_=0;
+  }
+  void RecordConvergedTemperatureField(std::vector<double>& temperature_field, double time){
+    std::swap(history_fields_[2], history_fields_[1]);
+    std::swap(history_fields_[1], history_fields_[0]);
+    history_times_[2]=history_times_[1];
+    history_times_[1]=history_times_[0];
+    history_fields_[0]=temperature_field;
+    history_times_[0]=time;
+    if(num_of_history_fields_<3) ++num_of_history_fields_;
+  }
+  //fills predicted_temperature_field for the time time_increment after the last recorded field
+  void PredictTemperatureField(std::vector<double>& initial_temperature_field, std::vector<double>& predicted_temperature_field, 
+    double time_increment){
+    ExtrapolateTemperatureField(initial_temperature_field, predicted_temperature_field, time_increment);
+    if(nested_iteration_model_!=NULL)
+      (*nested_iteration_model_).CorrectPredictedTemperatureField(initial_temperature_field, predicted_temperature_field, time_increment);
+  }
+
+private:
+  void ExtrapolateTemperatureField(std::vector<double>& initial_temperature_field, std::vector<double>& predicted_temperature_field, 
+    double time_increment){
+    int order=std::min(Constants::kTemperaturePredictorOrder_, num_of_history_fields_-1);
+    int num_of_nodes=predicted_temperature_field.size();
+    if(order<=0){
+      for(int i=0;i<num_of_nodes;i++) predicted_temperature_field[i]=initial_temperature_field[i];
+      return;
+    }
+    //lagrange weights of the recorded fields at the new time
+    double t=history_times_[0]+time_increment;
+    double w[3]={0.0, 0.0, 0.0};
+    for(int k=0;k<=order;k++){
+      w[k]=1.0;
+      for(int m=0;m<=order;m++)
+        if(m!=k) w[k] *= (t-history_times_[m])/(history_times_[k]-history_times_[m]);
+    }
+    const double* t0=history_fields_[0].data();
+    const double* t1=history_fields_[1].data();
+    const double* t2=history_fields_[2].data();
+    if(order==1)
+      for(int i=0;i<num_of_nodes;i++) predicted_temperature_field[i]=w[0]*t0[i]+w[1]*t1[i];
+    else
+      for(int i=0;i<num_of_nodes;i++) predicted_temperature_field[i]=w[0]*t0[i]+w[1]*t1[i]+w[2]*t2[i];
+  }
+
+  std::vector<double> history_fields_[3]; //newest first
+  double history_times_[3];
+  int num_of_history_fields_;
+  NestedIterationModel* nested_iteration_model_;
+};
+
+
 int main(){
   printf("\n\n\t*****Heat Transfer Simulation for Real Time Grain Growth Control of Copper Film*****\n");
   printf("\tThis code is developed for the project 'Real Time Control of Grain Growth in Metals' (NSF reference codes: 024E, 036E, 8022, AMPP)\n\n");
@@ -2084,9 +5168,11 @@ int main(){
   printf("\tRobert Hull hullr2@rpi.edu (Principal Investigator)\n\tJohn Wen (Co-Principal Investigator)\n\tAntoinette Maniatty (Co-Principal Investigator)\n\tDaniel Lewis (Co-Principal Investigator)\n\n");
   printf("\tCode developer: Yixuan Tan tany3@rpi.edu\n\n\n");
  
+  SetupTimeReport setup_time_report;
+  setup_time_report.InitializeSetupTimeReport();
   Initialization initialization;
   initialization.InitializeInitialization();
-  double ambient_temperature=(*(initialization.get_analysis_constants())).get_ambient_temperature();
+  setup_time_report.RecordStage("input");
   double initial_time_increment=(*(initialization.get_analysis_constants())).get_initial_time_increment();
   double minimum_time_increment=(*(initialization.get_analysis_constants())).get_minimum_time_increment();
   int maximum_time_steps=(*(initialization.get_analysis_constants())).get_maximum_time_steps();
@@ -2100,6 +5186,11 @@ int main(){
   int num_of_iterations_with_unchanged_time_increment=0;
   int iteration_number=0;
   double current_time=0.0;
+  bool is_newton_step_pending=false; // the residual at the last newton update has not been checked by the line search yet
+  double newton_step_length=1.0;
+  double residual_norm_before_newton_step=0.0;
+  int num_of_line_search_backtracks=0;
+  std::vector<double> temperature_field_before_newton_step;
   bool check_temperature_change_size_satisfiable;
   bool is_heaters_turned_off=false;
   double temperature_norm_last = 0.0;
@@ -2113,6 +5204,7 @@ int main(){
 //  generate_mesh.PrintCoordinatesResults(&initialization);
   std::vector<double> &x_coordinates = generate_mesh.get_x_coordinates();
   std::vector<double> &y_coordinates = generate_mesh.get_y_coordinates();
+  setup_time_report.RecordStage("mesh coordinates");
 
   DegreeOfFreedomAndEquationNumbers dof_and_equation_numbers;
   dof_and_equation_numbers.InitializeDegreeOfFreedomAndEquationNumbers(&initialization);
@@ -2124,16 +5216,44 @@ int main(){
   std::vector<int> &essential_bc_nodes = dof_and_equation_numbers.get_essential_bc_nodes();
   int num_of_equations = dof_and_equation_numbers.get_num_of_equations();
   std::vector<int> &equation_numbers_of_nodes = dof_and_equation_numbers.get_equation_numbers_of_nodes();
-  std::vector<int> &equation_numbers_in_elements = dof_and_equation_numbers.get_equation_numbers_in_elements();
+  setup_time_report.RecordStage("connectivity and equations");
 
   TemperatureDependentVariables temperature_dependent_variables;
   temperature_dependent_variables.InitializeTemperatureDependentVariables(&initialization);
+  //moment tensors and batched kernels integrate the quadratic fits in closed form; measured curves go through quadrature
+  if(!temperature_dependent_variables.is_conductivity_and_specific_heat_quadratic()){
+    Constants::kUseTensorIntegralAssembly_=false;
+    Constants::kUseBatchedSimdKernels_=false;
+  }
+  //the consistent tangent is only assembled by the fused element pass
+  //jacobian-free mode differences the fused residual; its assembled tangent only preconditions, so the symmetric one serves
+  if(Constants::kLinearSolverBackend_==2){
+    Constants::kUseFusedAssembly_=true;
+    Constants::kUseConsistentTangent_=false;
+  }
+  if(!Constants::kUseFusedAssembly_) Constants::kUseConsistentTangent_=false;
+  //single precision refinement and the pivot shift recovery are for the skyline direct factor only
+  if(Constants::kLinearSolverBackend_!=0){
+    Constants::kUseMixedPrecisionFactorization_=false;
+    Constants::kUsePivotShiftRecovery_=false;
+  }
+  //conjugate gradient and the cholesky backends need the symmetric tangent
+  if(Constants::kLinearSolverBackend_==1 || Constants::kLinearSolverBackend_>=3) Constants::kUseConsistentTangent_=false;
+  setup_time_report.RecordStage("material property tables");
 
   HalfBandWidth half_band_width;
   half_band_width.set_accumulative_half_band_width_vector(&initialization, &dof_and_equation_numbers);
 //  half_band_width.PrintHalfBandWidthInformation(num_of_equations);
   int size_of_desparsed_stiffness_matrix = half_band_width.get_size_of_desparsed_stiffness_matrix();
+  printf("%d equations, skyline profile holds %d entries\n", num_of_equations, size_of_desparsed_stiffness_matrix);
   std::vector<int>&accumulative_half_band_width_vector = half_band_width.get_accumulative_half_band_width_vector();
+  setup_time_report.RecordStage("skyline profile");
+  ElementScatterMap element_scatter_map;
+  if(Constants::kLinearSolverBackend_==2)
+    element_scatter_map.InitializeStencilScatterMap(&initialization, &dof_and_equation_numbers);
+  else
+    element_scatter_map.InitializeElementScatterMap(&initialization, &dof_and_equation_numbers, &half_band_width);
+  setup_time_report.RecordStage("element scatter map");
 
   BoundaryCondition boundary_condition;
   boundary_condition.InitializeBoundaryCondition(&initialization);
@@ -2144,31 +5264,20 @@ int main(){
   heater_elements.InitializeHeaterElements(&initialization);
   heater_elements.set_elements_as_heater(&initialization);
 //  heater_elements.PrintHeaterElements();
-  int num_of_elements_as_heater=heater_elements.get_num_of_elements_as_heater();
-  std::vector<int>&elements_as_heater=heater_elements.get_elements_as_heater();
 
   RadiationElements radiation_elements;
   radiation_elements.InitializeRadiationElements(&initialization);
   radiation_elements.set_elements_with_radiation(&initialization);
 //  radiation_elements.PrintRadiationElements();
-  int num_of_elements_with_radiation=radiation_elements.get_num_of_elements_with_radiation();
-  std::vector<int> &elements_with_radiation=radiation_elements.get_elements_with_radiation(); 
 
   MaterialParameters material_parameters;
   material_parameters.set_densities();
   material_parameters.set_material_id_of_elements(&initialization);
 //  material_parameters.PrintMaterialParameters();
-  std::vector<int>& material_id_of_elements = material_parameters.get_material_id_of_elements();
-  std::vector<double>& densities = material_parameters.get_densities();
+  setup_time_report.RecordStage("boundary, heater and materials");
 
   GlobalVectorsAndMatrices global_vectors_and_matrices;
   global_vectors_and_matrices.InitializeGlobalVectorsAndMatrices(num_of_nodes, accumulative_half_band_width_vector);
-  std::vector<double>& stiffness_matrix = global_vectors_and_matrices.get_stiffness_matrix();
-  std::vector<double>& mass_matrix = global_vectors_and_matrices.get_mass_matrix();
-  std::vector<double>& radiation_tangential_matrix = global_vectors_and_matrices.get_radiation_tangential_matrix();
-  std::vector<double>& body_heat_flux_tangential_matrix = global_vectors_and_matrices.get_body_heat_flux_tangential();
-  std::vector<double>& heat_load = global_vectors_and_matrices.get_heat_load();
-  std::vector<double>& radiation_load = global_vectors_and_matrices.get_radiation_load();
   std::vector<double>& current_temperature_field = global_vectors_and_matrices.get_current_temperature_field();
   std::vector<double>& right_hand_side_function = global_vectors_and_matrices.get_right_hand_side_function();
   std::vector<double>& jacobian_matrix_global = global_vectors_and_matrices.get_jacobian_matrix_global();
@@ -2180,87 +5289,105 @@ int main(){
   temperature_field_initial.set_initial_temperature_field(essential_bc_nodes, initial_temperature_field, &initialization, 
   equation_numbers_of_nodes);
 //  temperature_field_initial.PrintInitialTemperatureField(initial_temperature_field);
-
-  ElementalStiffnessMatrix elemental_stiffness_matrix;
-  elemental_stiffness_matrix.InitializeElementalStiffnessMatrix();
-  ElementalMassMatrix elemental_mass_matrix;
-  elemental_mass_matrix.InitializeElementalMassMatrix();
-
-  ElementalBodyHeatFluxTangentialMatrix elemental_body_heat_flux_tangential_matrix;
-  elemental_body_heat_flux_tangential_matrix.InitializeElementalBodyHeatFluxTangentialMatrix();
-  ElementalRadiationTangentialMatrixAndRadiationLoad elemental_radiation_tangential_matrix_and_radiation_load;
-  elemental_radiation_tangential_matrix_and_radiation_load.InitializeElementalRadiationTangentialMatrixAndRadiationLoad();
-  Assemble assemble;
+  setup_time_report.RecordStage("global storage");
+
+  //geometry of the fixed mesh is evaluated once for the 3x3 (conduction, capacity) and 2x2 (joule heating) gauss rules
+  ElementGeometryCache geometry_cache_three_by_three;
+  geometry_cache_three_by_three.InitializeElementGeometryCache(3, GaussLegendreRule<3>::kCoordinates_.data(), 
+    GaussLegendreRule<3>::kWeights_.data(), num_of_elements, nodes_in_elements, x_coordinates, y_coordinates);
+  ElementGeometryCache geometry_cache_two_by_two;
+  geometry_cache_two_by_two.InitializeElementGeometryCache(2, GaussLegendreRule<2>::kCoordinates_.data(), 
+    GaussLegendreRule<2>::kWeights_.data(), num_of_elements, nodes_in_elements, x_coordinates, y_coordinates);
+  setup_time_report.RecordStage("element geometry caches");
+
+  ElementTensorIntegrals element_tensor_integrals;
+  //the fused batched kernels integrate K and M themselves and never read the moment tensors
+  if(Constants::kUseTensorIntegralAssembly_ && (!Constants::kUseFusedAssembly_ || !Constants::kUseBatchedSimdKernels_))
+    element_tensor_integrals.InitializeElementTensorIntegrals(num_of_elements, &geometry_cache_three_by_three);
+  setup_time_report.RecordStage("element tensor integrals");
+
+  ParallelAssembly parallel_assembly;
+  parallel_assembly.InitializeParallelAssembly(&initialization, &generate_mesh, &dof_and_equation_numbers, &element_scatter_map, &boundary_condition, 
+    &heater_elements, &radiation_elements, &material_parameters, &temperature_dependent_variables, &geometry_cache_three_by_three, 
+    &geometry_cache_two_by_two, &element_tensor_integrals);
+  setup_time_report.RecordStage("parallel assembly");
+  GeometricMultigrid geometric_multigrid;
+  if((Constants::kLinearSolverBackend_==1 && Constants::kPcgPreconditioner_==2) || Constants::kLinearSolverBackend_==2){
+    geometric_multigrid.InitializeGeometricMultigrid(&initialization, &generate_mesh, &dof_and_equation_numbers);
+    geometric_multigrid.PrintGeometricMultigridLevels();
+  }
   Solver solver;
+  solver.InitializeSolver(&dof_and_equation_numbers, accumulative_half_band_width_vector, &geometric_multigrid, &parallel_assembly);
+  setup_time_report.RecordStage("linear solver");
+  if(Constants::kLinearSolverBackend_==4)
+    printf("nested dissection sparse cholesky factor holds %d entries\n", solver.get_num_of_sparse_factor_entries());
+  NestedIterationModel nested_iteration_model;
+  if(Constants::kUseNestedIteration_){
+    nested_iteration_model.InitializeNestedIterationModel(&initialization, &generate_mesh, &temperature_dependent_variables);
+    printf("nested iteration coarse mesh holds %d equations\n", nested_iteration_model.get_num_of_equations());
+  }
+  setup_time_report.RecordStage("nested iteration model");
+  printf("element assembly runs on %d thread(s)\n", parallel_assembly.get_num_of_threads());
+  setup_time_report.PrintSetupTimeReport();
+  Assemble assemble;
   OutputResults output_results;
+  TemperaturePredictor temperature_predictor;
+  temperature_predictor.InitializeTemperaturePredictor(num_of_nodes);
+  if(Constants::kUseNestedIteration_) temperature_predictor.set_nested_iteration_model(&nested_iteration_model);
+  temperature_predictor.RecordConvergedTemperatureField(initial_temperature_field, current_time);
 
   for(int time_step=0; current_time<=total_simulation_time; time_step++){
     if(time_step>=maximum_time_steps){
       printf("maximum time steps has been reached. simulation aborted\n");
+      solver.PrintLinearSolverStatistics();
+      if(Constants::kUseNestedIteration_) nested_iteration_model.PrintNestedIterationStatistics();
       exit(-1);
     }  
  
-    for(int i=0; i<current_temperature_field.size(); i++)
-      current_temperature_field[i]=initial_temperature_field[i];  // set initial values to dLastitersolu[]
+    temperature_predictor.PredictTemperatureField(initial_temperature_field, current_temperature_field, time_increment);
+    solver.ResetContractionHistory();
     while(1){
-      global_vectors_and_matrices.ZeroVectorAndMatrix();
-
-      for(int element_number=0;element_number<num_of_elements;element_number++){
-        elemental_stiffness_matrix.set_coordinates_in_this_element(element_number, nodes_in_elements, x_coordinates, y_coordinates);
-        elemental_stiffness_matrix.set_element_stiffness_matrix(element_number, nodes_in_elements, material_id_of_elements, 
-          current_temperature_field, &temperature_dependent_variables);
-        elemental_stiffness_matrix.MapElementalToGlobalStiffness(stiffness_matrix, accumulative_half_band_width_vector, 
-          equation_numbers_in_elements, element_number);
-        std::vector<std::vector<double> >&element_stiffness_matrix = elemental_stiffness_matrix.get_element_stiffness_matrix();
-
-        elemental_mass_matrix.set_coordinates_in_this_element(element_number, nodes_in_elements, x_coordinates, y_coordinates);
-        elemental_mass_matrix.set_element_mass_matrix(element_number, nodes_in_elements, material_id_of_elements, current_temperature_field, 
-          &temperature_dependent_variables, densities, time_increment);
-        elemental_mass_matrix.MapElementalToGlobalMass(mass_matrix, accumulative_half_band_width_vector,equation_numbers_in_elements, 
-          element_number);
-
-        boundary_condition.FixTemperature(element_number, element_stiffness_matrix, equation_numbers_in_elements, heat_load);
+      if(Constants::kLinearSolverBackend_==2){ //the jacobian-free solver assembles its lagged preconditioner itself
+        parallel_assembly.AssembleFusedResidual(&global_vectors_and_matrices, time_increment);
       }
-
-
-      for(int heater_element_number=0; heater_element_number<num_of_elements_as_heater; heater_element_number++){
-        int element_number=elements_as_heater[heater_element_number];
-        elemental_body_heat_flux_tangential_matrix.set_coordinates_in_this_element(element_number, nodes_in_elements, x_coordinates, 
-          y_coordinates);
-        elemental_body_heat_flux_tangential_matrix.set_element_body_heat_flux_tangential_matrix(element_number, heater_element_number, 
-          nodes_in_elements, current_temperature_field, &temperature_dependent_variables, &initialization);
-        elemental_body_heat_flux_tangential_matrix.MapElementalToGlobalBodyHeatFluxTangentialMatrix(body_heat_flux_tangential_matrix, 
-          accumulative_half_band_width_vector, equation_numbers_in_elements, element_number);
-
-        heater_elements.set_coordinates_in_this_element(element_number, nodes_in_elements, x_coordinates, y_coordinates);
-        heater_elements.HeatSupply(element_number, heater_element_number, heat_load, nodes_in_elements, 
-        equation_numbers_in_elements,current_temperature_field, &temperature_dependent_variables,&initialization);
+      else if(Constants::kUseFusedAssembly_){
+        global_vectors_and_matrices.ZeroVectorAndMatrix();
+        parallel_assembly.AssembleFusedJacobianAndResidual(&global_vectors_and_matrices, time_increment);
       }
- 
-//    elemental_body_heat_flux_tangential_matrix.PrintBodyHeatFluxTangentialMatrix(body_heat_flux_tangential_matrix);
-
-      for(int radiation_element_number=0;radiation_element_number<num_of_elements_with_radiation;radiation_element_number++){
-        int element_number=elements_with_radiation[radiation_element_number];
-        elemental_radiation_tangential_matrix_and_radiation_load.set_element_radiation_tangential_matrix_and_radiation_load(element_number, 
-          radiation_element_number, nodes_in_elements, current_temperature_field, &temperature_dependent_variables, x_coordinates, 
-          ambient_temperature);
-        elemental_radiation_tangential_matrix_and_radiation_load.MapElementalToGlobalRadiationTangentialMatrixAndRadiationLoad
-          (radiation_tangential_matrix, accumulative_half_band_width_vector, radiation_load, equation_numbers_in_elements, element_number);
+      else{
+        global_vectors_and_matrices.ZeroVectorAndMatrix();
+        parallel_assembly.AssembleElementContributions(&global_vectors_and_matrices, time_increment);
+        assemble.AssembleGlobalJacobian(&global_vectors_and_matrices);
+        assemble.AssembleGlobalYfunction(equation_numbers_of_nodes, &global_vectors_and_matrices);
       }
-
-//      elemental_radiation_tangential_matrix_and_radiation_load.PrintRadiationTangentialMatrixAndRadiationLoad(radiation_tangential_matrix,
-//        radiation_load);
-
-      assemble.AssembleGlobalJacobian(&global_vectors_and_matrices);
-      assemble.AssembleGlobalYfunction(equation_numbers_of_nodes, &global_vectors_and_matrices);
 //      assemble.PrintGlobalJacobian(&global_vectors_and_matrices);
 //      assemble.PrintGlobalYfunction(&global_vectors_and_matrices);
 
 
 //     printf("%.6f %.6f\n",solver.NormOfVector(solution_of_last_iteration),solver.NormOfVector(right_hand_side_function));
 
+      double residual_norm=solver.NormOfVector(right_hand_side_function);
+      if(is_newton_step_pending){ // the assembly above evaluated the residual at the last update, backtrack it if the decrease is too small
+        is_newton_step_pending=false;
+        if(residual_norm>=Constants::kYFunctionTolerance_ 
+           && residual_norm>(1.0-Constants::kLineSearchSufficientDecrease_*newton_step_length)*residual_norm_before_newton_step 
+           && newton_step_length>pow(0.5, Constants::kMaxLineSearchBacktracks_)){
+          newton_step_length *= 0.5;
+          ++num_of_line_search_backtracks;
+          printf("line search: residual norm %.3e after step length %g, backtrack to %g\n", residual_norm, 2.0*newton_step_length, 
+            newton_step_length);
+          for(int j=0; j<num_of_nodes; j++){
+            int equation_count=equation_numbers_of_nodes[j];
+            if(equation_count>=0)
+              current_temperature_field[j]=temperature_field_before_newton_step[j]+newton_step_length*solution_of_last_iteration[equation_count];
+          }
+          is_newton_step_pending=true;
+          continue; //reassemble at the shorter step
+        }
+      }
+
       if(solver.NormOfVector(solution_of_last_iteration)<Constants::kNormTolerance_ && 
-      solver.NormOfVector(right_hand_side_function)<Constants::kYFunctionTolerance_){// convergence must be satisfied first, then consider temperature increment size.
+      residual_norm<Constants::kYFunctionTolerance_){// convergence must be satisfied first, then consider temperature increment size.
 
         for(int j=0; j<num_of_nodes; j++){
           check_temperature_change_size_satisfiable=true;
@@ -2273,8 +5400,7 @@ int main(){
             printf("reduce time increment size1\n");
             num_of_iterations_with_unchanged_time_increment=0;
             iteration_number=0; //zero back the iteration num counting;
-            for(int i=0; i<num_of_nodes; i++)
-              current_temperature_field[i]=initial_temperature_field[i];  // set initial values to current_temperature_field[]
+            temperature_predictor.PredictTemperatureField(initial_temperature_field, current_temperature_field, time_increment);
             check_temperature_change_size_satisfiable=false;
 
             break; // break from the for loop
@@ -2289,14 +5415,14 @@ int main(){
             time_increment = (time_to_turn_off_heaters-current_time);
             num_of_iterations_with_unchanged_time_increment=0;
             iteration_number=0; //zero back the iteration num counting;
-            for(int i=0; i<num_of_nodes; i++)
-              current_temperature_field[i]=initial_temperature_field[i];  // set initial values to current_temperature_field[]
+            temperature_predictor.PredictTemperatureField(initial_temperature_field, current_temperature_field, time_increment);
             continue; //continue the while loop
           }
           if((current_time+time_increment)==time_to_turn_off_heaters){
             for(int k=0; k<(*(initialization.get_currents_in_heater())).get_current_in_heater().size(); k++)
               (*(initialization.get_currents_in_heater())).get_current_in_heater()[k]=0.0;
             is_heaters_turned_off==true;
+            temperature_predictor.ResetTemperaturePredictor(); //the heating history does not extrapolate past the switch off
           }
         }
 
@@ -2312,12 +5438,15 @@ int main(){
           printf("time increment size increased\n");
         }
         printf("number of iteration to converge is %d\n",iteration_number);
+        if(Constants::kUseNewtonLineSearch_)
+          printf("number of line search backtracks is %d\n",num_of_line_search_backtracks);
+        num_of_line_search_backtracks=0;
         break;  // break from the while loop
       }//if
 
       ++iteration_number;
 
-      if(solver.LinearEquationsSolver(&global_vectors_and_matrices)==1){
+      if(solver.LinearEquationsSolver(&global_vectors_and_matrices, time_increment)==1){
         time_increment /= 4; 
         if(time_increment<(minimum_time_increment)){
           printf("time increment size is too small. simulation aborted!\n");
@@ -2326,8 +5455,7 @@ int main(){
         printf("reduce time increment size2\n");
         num_of_iterations_with_unchanged_time_increment=0;
         iteration_number=0; //zero back the iteration num counting;
-        for(int i=0; i<num_of_nodes; i++)
-          current_temperature_field[i]=initial_temperature_field[i];  // set initial values to current_temperature_field[]
+        temperature_predictor.PredictTemperatureField(initial_temperature_field, current_temperature_field, time_increment);
 
         continue;
       }
@@ -2341,11 +5469,16 @@ int main(){
         printf("reduce time increment size3\n");
         num_of_iterations_with_unchanged_time_increment=0;
         iteration_number=0; //zero back the iteration num counting;
-        for(int i=0; i<num_of_nodes; i++)
-          current_temperature_field[i]=initial_temperature_field[i];  // set initial values to current_temperature_field[]
+        temperature_predictor.PredictTemperatureField(initial_temperature_field, current_temperature_field, time_increment);
         continue;
       }
 
+      if(Constants::kUseNewtonLineSearch_){ //full step first, its residual is checked by the next assembly
+        temperature_field_before_newton_step=current_temperature_field;
+        residual_norm_before_newton_step=residual_norm;
+        newton_step_length=1.0;
+        is_newton_step_pending=true;
+      }
       for(int j=0; j<num_of_nodes; j++){
         int equation_count=equation_numbers_of_nodes[j];
         if(equation_count>=0)
@@ -2357,6 +5490,7 @@ int main(){
     for(int i=0; i<num_of_nodes; i++){
       initial_temperature_field[i]=current_temperature_field[i];
     }
+    temperature_predictor.RecordConvergedTemperatureField(initial_temperature_field, current_time);
 
     temperature_norm_last = temperature_norm_current;
     temperature_norm_current = solver.NormOfVector(initial_temperature_field);
@@ -2387,6 +5521,8 @@ int main(){
   }
   fclose(current_densities);
 
+  solver.PrintLinearSolverStatistics();
+  if(Constants::kUseNestedIteration_) nested_iteration_model.PrintNestedIterationStatistics();
   printf("Analysis completed successfully!\n");
   printf("several (model temperature field).vtk files, (copper surface temperature).txt files and a (current_density).txt file have been generated\n\n");
   return 0;